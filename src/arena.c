@@ -0,0 +1,79 @@
+/* arena.c - arenaalloc, arenarelease */
+#include "types.h"
+#include "memory.h"
+
+/* Usable bytes in a chunk of the given page order */
+#define ACHUNKSIZE(order)  ((uint32_t)PAGE_SIZE << (order))
+
+/*------------------------------------------------------------------------
+* arenaalloc - Bump-allocate nbytes from an arena, adding chunks as needed
+*------------------------------------------------------------------------
+*/
+void *arenaalloc(
+    struct archunk **arena, /* Arena's chunk list (head is current) */
+    uint32_t nbytes /* Size of memory requested */
+)
+{
+    struct archunk *chunk = *arena;
+    uint32_t hdr = (sizeof(struct archunk) + 7) & ~7;
+    int order;
+    void *p;
+
+    if (nbytes == 0)
+        return NULL;
+    nbytes = (nbytes + 7) & ~7;
+
+    /* Fast path: bump within the current chunk */
+    if (chunk != NULL && chunk->aused + nbytes <= ACHUNKSIZE(chunk->aorder))
+    {
+        p = (void *)((uintptr_t)chunk + chunk->aused);
+        chunk->aused += nbytes;
+        return p;
+    }
+
+    order = pgorder(hdr + nbytes);
+    if (order < ARENA_ORDER)
+        order = ARENA_ORDER;
+    if (ACHUNKSIZE(order) < hdr + nbytes)
+        return NULL;
+    p = alloc_pages(order);
+    if (p == NULL)
+        return NULL;
+
+    struct archunk *fresh = (struct archunk *)p;
+    fresh->aorder = order;
+    fresh->aused = hdr + nbytes;
+
+    /* A chunk that is already full goes behind the current one so
+     * small requests keep bumping where they were */
+    if (chunk != NULL && fresh->aused == ACHUNKSIZE(order))
+    {
+        fresh->anext = chunk->anext;
+        chunk->anext = fresh;
+    }
+    else
+    {
+        fresh->anext = chunk;
+        *arena = fresh;
+    }
+    return (void *)((uintptr_t)fresh + hdr);
+}
+
+/*------------------------------------------------------------------------
+* arenarelease - Return every chunk of an arena to the page allocator
+*------------------------------------------------------------------------
+*/
+void arenarelease(
+    struct archunk **arena /* Arena's chunk list; emptied on return */
+)
+{
+    struct archunk *chunk = *arena;
+
+    while (chunk != NULL)
+    {
+        struct archunk *next = chunk->anext;
+        free_pages(chunk, chunk->aorder);
+        chunk = next;
+    }
+    *arena = NULL;
+}
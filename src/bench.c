@@ -0,0 +1,328 @@
+/* bench.c - bench_main: kernel microbenchmarks for the make bench image
+ *
+ * kernel.c built with -DKACCHI_BENCH starts bench_main instead of the
+ * shell. Each benchmark takes NSAMP samples in TSC cycles and prints
+ * one line
+ *
+ *   BENCH <name> n=<samples> min=<c> median=<c> p99=<c> max=<c>
+ *
+ * then "BENCH done", and the image powers QEMU off through the
+ * isa-debug-exit device. Samples include whatever timer ticks land in
+ * them; that is what p99 and max are for.
+ */
+#include "types.h"
+#include "serial.h"
+#include "memory.h"
+#include "process.h"
+#include "scheduler.h"
+#include "intr.h"
+#include "io.h"
+#include "x86.h"
+
+#define NSAMP       1000
+#define DEBUGEXIT   0xF4    /* isa-debug-exit iobase (Makefile) */
+
+static uint32_t samp[NSAMP];
+
+/* Sort the samples and print their summary */
+static void benchline(const char *name, int n)
+{
+    uint32_t v;
+    int j;
+
+    if (n == 0)
+        return;
+    for (int gap = n / 2; gap > 0; gap /= 2)
+        for (int i = gap; i < n; i++) {
+            v = samp[i];
+            for (j = i; j >= gap && samp[j - gap] > v; j -= gap)
+                samp[j] = samp[j - gap];
+            samp[j] = v;
+        }
+
+    serial_puts("BENCH ");
+    serial_puts(name);
+    serial_puts(" n=");
+    serial_putdec(n);
+    serial_puts(" min=");
+    serial_putdec(samp[0]);
+    serial_puts(" median=");
+    serial_putdec(samp[n / 2]);
+    serial_puts(" p99=");
+    serial_putdec(samp[n * 99 / 100]);
+    serial_puts(" max=");
+    serial_putdec(samp[n - 1]);
+    serial_puts("\n");
+}
+
+/* -----------------------------
+ * ctx_switch: two bare stacks, no scheduler
+ * ----------------------------- */
+
+static uint32_t *benchsp, *peersp;
+
+static void ctxpeer(void)
+{
+    for (;;)
+        ctx_switch(&peersp, benchsp);
+}
+
+static void bench_ctx(void)
+{
+    intmask mask; /* Saved interrupt mask */
+    uint32_t *stk = getstk(PROC_STACK_SIZE);
+    uint32_t *sp, t;
+
+    if (stk == NULL)
+        return;
+    sp = (uint32_t *)((uint32_t)stk & ~0xF);
+    *(--sp) = 0;                    /* ctxpeer never returns */
+    *(--sp) = (uint32_t)ctxpeer;
+    for (int i = 0; i < 4; i++)
+        *(--sp) = 0;                /* EBP, EBX, ESI, EDI */
+    peersp = sp;
+
+    /* Each sample is a switch there and back: half is one switch */
+    mask = disable();
+    for (int i = 0; i < NSAMP; i++) {
+        t = (uint32_t)rdtsc();
+        ctx_switch(&benchsp, peersp);
+        samp[i] = ((uint32_t)rdtsc() - t) / 2;
+    }
+    restore(mask);
+    freestk(stk, PROC_STACK_SIZE);
+    benchline("ctx_switch", NSAMP);
+}
+
+/* -----------------------------
+ * yield() round trips among n processes
+ * ----------------------------- */
+
+static volatile int benchstop;
+static volatile int nlive;
+
+static void yielder(void)
+{
+    intmask mask; /* Saved interrupt mask */
+
+    while (!benchstop)
+        yield();
+    mask = disable();
+    nlive--;
+    restore(mask);
+}
+
+static void bench_yield(int n, const char *name)
+{
+    uint32_t t;
+
+    benchstop = 0;
+    nlive = n - 1;
+    for (int i = 1; i < n; i++)
+        process_create(yielder, "yielder");
+    yield();    /* Let them all start */
+
+    for (int i = 0; i < NSAMP; i++) {
+        t = (uint32_t)rdtsc();
+        yield();
+        samp[i] = (uint32_t)rdtsc() - t;
+    }
+
+    benchstop = 1;
+    while (nlive > 0)
+        yield();
+
+    benchline(name, NSAMP);
+}
+
+/* -----------------------------
+ * send/receive and sendrecv ping-pong
+ * ----------------------------- */
+
+static int benchpid;
+
+static void echo(void)
+{
+    msg_t m;
+
+    while (receive(&m) == 0 && m >= 0)
+        send(benchpid, m);
+}
+
+static void echorr(void)
+{
+    msg_t m;
+
+    if (receive(&m) != 0)
+        return;
+    while (sendrecv(benchpid, m, &m) == 0 && m >= 0)
+        ;
+}
+
+static void bench_ipc(void)
+{
+    uint32_t t;
+    msg_t m;
+    int pid;
+
+    benchpid = getpid();
+    pid = process_create(echo, "echo");
+    for (int i = 0; i < NSAMP; i++) {
+        t = (uint32_t)rdtsc();
+        send(pid, i);
+        receive(&m);
+        samp[i] = (uint32_t)rdtsc() - t;
+    }
+    send(pid, -1);
+    benchline("send_receive_rt", NSAMP);
+
+    pid = process_create(echorr, "echorr");
+    sendrecv(pid, 0, &m);
+    for (int i = 0; i < NSAMP; i++) {
+        t = (uint32_t)rdtsc();
+        sendrecv(pid, i, &m);
+        samp[i] = (uint32_t)rdtsc() - t;
+    }
+    send(pid, -1);
+    benchline("sendrecv_rt", NSAMP);
+}
+
+/* -----------------------------
+ * process_create and a whole create-run-exit cycle
+ * ----------------------------- */
+
+static void nop(void *arg)
+{
+    (void)arg;
+}
+
+/* A sample that could not be taken: say so rather than time nothing */
+static void benchfail(const char *name)
+{
+    serial_puts("BENCH ");
+    serial_puts(name);
+    serial_puts(" error=process_create_ex\n");
+}
+
+static void bench_create(void)
+{
+    uint32_t t;
+    int prio, n;
+
+    /* Aging may have raised us to the top; leave a priority above */
+    set_priority(getpid(), MAX_PRIO - 2);
+    prio = get_priority(getpid());
+
+    /* At our priority: it runs (and exits) only when we yield */
+    for (n = 0; n < NSAMP; n++) {
+        t = (uint32_t)rdtsc();
+        if (process_create_ex(nop, "nop", 0, prio, NULL) < 0) {
+            benchfail("process_create");
+            break;
+        }
+        samp[n] = (uint32_t)rdtsc() - t;
+        yield();
+    }
+    benchline("process_create", n);
+
+    /* Created above us: the yield returns after it has exited */
+    for (n = 0; n < NSAMP; n++) {
+        t = (uint32_t)rdtsc();
+        if (process_create_ex(nop, "nop", 0, prio + 1, NULL) < 0) {
+            benchfail("create_run_exit");
+            break;
+        }
+        yield();
+        samp[n] = (uint32_t)rdtsc() - t;
+    }
+    benchline("create_run_exit", n);
+}
+
+/* -----------------------------
+ * Allocators
+ * ----------------------------- */
+
+static void *blk[NSAMP];
+
+static void bench_mem(uint32_t nbytes, const char *getname,
+                      const char *freename)
+{
+    uint32_t t;
+
+    for (int i = 0; i < NSAMP; i++) {
+        t = (uint32_t)rdtsc();
+        blk[i] = getmem(nbytes);
+        samp[i] = (uint32_t)rdtsc() - t;
+    }
+    benchline(getname, NSAMP);
+    for (int i = NSAMP - 1; i >= 0; i--) {
+        t = (uint32_t)rdtsc();
+        freemem(blk[i], nbytes);
+        samp[i] = (uint32_t)rdtsc() - t;
+    }
+    benchline(freename, NSAMP);
+}
+
+static void bench_stk(void)
+{
+    uint32_t t;
+    int n = 0;
+
+    for (int i = 0; i < NSAMP; i++) {
+        t = (uint32_t)rdtsc();
+        blk[i] = getstk(PROC_STACK_SIZE);
+        samp[i] = (uint32_t)rdtsc() - t;
+        if (blk[i] == NULL)
+            break;
+        n++;
+    }
+    benchline("getstk_4096", n);
+    for (int i = n - 1; i >= 0; i--) {
+        t = (uint32_t)rdtsc();
+        freestk(blk[i], PROC_STACK_SIZE);
+        samp[i] = (uint32_t)rdtsc() - t;
+    }
+    benchline("freestk_4096", n);
+
+    /* Pooled stacks, in batches the pool can hold */
+    n = 0;
+    for (int i = 0; i < NSAMP && i < NPOOLSTK / 2; i++) {
+        t = (uint32_t)rdtsc();
+        blk[i] = getpstk();
+        samp[i] = (uint32_t)rdtsc() - t;
+        if (blk[i] == NULL)
+            break;
+        n++;
+    }
+    benchline("getpstk", n);
+    for (int i = n - 1; i >= 0; i--) {
+        t = (uint32_t)rdtsc();
+        freepstk(blk[i]);
+        samp[i] = (uint32_t)rdtsc() - t;
+    }
+    benchline("freepstk", n);
+}
+
+/*------------------------------------------------------------------------
+* bench_main - Run every benchmark, then power off
+*------------------------------------------------------------------------
+*/
+void bench_main(void)
+{
+    serial_puts("BENCH start\n");
+    bench_ctx();
+    bench_yield(2, "yield_rt_n2");
+    bench_yield(8, "yield_rt_n8");
+    bench_yield(32, "yield_rt_n32");
+    bench_ipc();
+    bench_create();
+    bench_mem(64, "getmem_64", "freemem_64");
+    bench_mem(1024, "getmem_1024", "freemem_1024");
+    bench_stk();
+    serial_puts("BENCH done\n");
+
+    /* QEMU exits with status (0 << 1) | 1 */
+    outb(DEBUGEXIT, 0);
+    for (;;)
+        __asm__ volatile ("hlt");
+}
@@ -0,0 +1,109 @@
+/* clock.c - clkinit, clkhandler, clktick, tsckhz */
+#include "types.h"
+#include "io.h"
+#include "intr.h"
+#include "clock.h"
+#include "scheduler.h"
+#include "process.h"
+#include "smp.h"
+#include "x86.h"
+
+#define PIT_CH0     0x40
+#define PIT_CMD     0x43
+
+uint32_t clkticks;
+
+static uint32_t tsckhzval;  /* tsckhz() once measured */
+
+/*------------------------------------------------------------------------
+* clkinit - Program PIT channel 0 for CLKHZ and install clkhandler
+*------------------------------------------------------------------------
+*/
+void clkinit(void)
+{
+    uint32_t divisor = (PITHZ + CLKHZ / 2) / CLKHZ;
+
+    clkticks = 0;
+    twinit();
+    outb(PIT_CMD, 0x34);            /* Channel 0, lo/hi byte, rate generator */
+    outb(PIT_CH0, divisor & 0xFF);
+    outb(PIT_CH0, (divisor >> 8) & 0xFF);
+    set_irq_handler(IRQ_TIMER, clkhandler);
+}
+
+/*------------------------------------------------------------------------
+* clkhandler - Timer tick, boot CPU only: count it, pass it on to the
+*              other CPUs, wake sleepers that are due, then do this
+*              CPU's share of the tick. Runs with interrupts disabled.
+*------------------------------------------------------------------------
+*/
+void clkhandler(void)
+{
+    clkticks++;
+#ifdef KACCHI_SMP
+    if (ncpu > 1)
+        ipi_broadcast(IPI_TICK);
+#endif
+    twtick();
+    clktick();
+}
+
+/*------------------------------------------------------------------------
+* clktick - Per-CPU tick: preempt the running process when its time
+*           slice runs out, or when a process that outranks it is queued
+*           here (a sleeper woke, or something was readied). An idle
+*           process yields every tick so its CPU can steal work.
+*           schedule() reloads preempt for whichever process runs next.
+*           EDF processes go by budget and deadline instead (edftick).
+*------------------------------------------------------------------------
+*/
+void clktick(void)
+{
+    struct cpu *c = mycpu();
+    struct pcb *p = proctab(currpid);
+
+    if (edftick())
+        return;
+
+    if (isidle(currpid) || rq_maxprio() > p->priority) {
+        p->pflags |= PF_PREEMPT;
+        yield();
+        return;
+    }
+    if (c->preempt > 0 && --c->preempt == 0) {
+        p->pflags |= PF_PREEMPT;
+        yield();
+    }
+}
+
+/*------------------------------------------------------------------------
+* tsckhz - TSC ticks per millisecond, timed against the clock tick the
+*          first time (about 10 ms; interrupts must be on)
+*------------------------------------------------------------------------
+*/
+uint32_t tsckhz(void)
+{
+    if (tsckhzval != 0)
+        return tsckhzval;
+
+#ifdef KACCHI_HOSTED
+    /* Virtual time stands still while we spin */
+    tsckhzval = hosttsckhz();
+#else
+    volatile uint32_t *ticks = &clkticks;
+    uint32_t n = MSTOTICKS(10);
+    uint32_t ms = n * 1000 / CLKHZ;
+    uint32_t t, start;
+
+    /* Start on a tick edge */
+    t = *ticks;
+    while (*ticks == t)
+        __asm__ volatile ("pause");
+    start = (uint32_t)rdtsc();
+    t = *ticks;
+    while (*ticks - t < n)
+        __asm__ volatile ("pause");
+    tsckhzval = ((uint32_t)rdtsc() - start) / (ms ? ms : 1);
+#endif
+    return tsckhzval;
+}
@@ -0,0 +1,49 @@
+/* clock.h - PIT tick and time-slice definitions */
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include "types.h"
+
+/* Tick rate; override with make CFLAGS+=-DCLKHZ=... */
+#ifndef CLKHZ
+#define CLKHZ       1000
+#endif
+
+#define PITHZ       1193182 /* PIT input clock */
+
+/* Milliseconds to ticks, rounded up */
+#define MSTOTICKS(ms)  (((uint32_t)(ms) * CLKHZ + 999) / 1000)
+
+extern uint32_t clkticks;   /* Ticks since clkinit */
+
+void clkinit(void);
+void clkhandler(void);
+void clktick(void);
+uint32_t tsckhz(void);
+
+/* -----------------------------
+ * Timing wheel
+ * -----------------------------
+ * Sleeping processes hang off TW_LEVELS wheels of TW_SIZE slots,
+ * linked through their PCBs. Level n slot i holds wakeups due in the
+ * lap of TW_SIZE^n ticks numbered i. Insert and cancel are O(1). Each
+ * tick empties one level-0 slot, and every TW_SIZE^n ticks one level-n
+ * slot is spread over the levels below it, so each sleeper is moved at
+ * most TW_LEVELS times.
+ */
+#define TW_BITS     6
+#define TW_SIZE     (1 << TW_BITS)
+#define TW_MASK     (TW_SIZE - 1)
+#define TW_LEVELS   4
+
+void twinit(void);
+void twinsert(int pid, uint32_t when);
+void twremove(int pid);
+int twtick(void);
+
+/* Sleep API */
+int sleep_ticks(uint32_t ticks);
+int sleep_ms(uint32_t ms);
+int unsleep(int pid);
+
+#endif
@@ -0,0 +1,47 @@
+/* cpu.c - CPU feature probe and SSE enable */
+#include "types.h"
+#include "x86.h"
+#include "serial.h"
+#include "string.h"
+
+/*------------------------------------------------------------------------
+ * cpu_init - Enable SSE if CPUID reports it and select the mem* routines.
+ *            Assumes CPUID exists (any i586 or later). CPUs with fast
+ *            rep movs (ERMS) keep the rep paths, which beat SSE2 there.
+ *            Leaves CR0.TS set, so FPU state is switched lazily.
+ *------------------------------------------------------------------------
+ */
+void cpu_init(void)
+{
+    uint32_t a, b, c, d;
+    uint32_t maxleaf;
+    uint32_t need = CPUID_FXSR | CPUID_SSE | CPUID_SSE2;
+
+    cpuid(0, &maxleaf, &b, &c, &d);
+    if (maxleaf < 1) {
+        serial_puts("cpu: no CPUID leaf 1, byte/word string routines\n");
+        return;
+    }
+    cpuid(1, &a, &b, &c, &d);
+    if ((d & need) != need) {
+        serial_puts("cpu: no SSE2, word string routines\n");
+        return;
+    }
+
+    write_cr0((read_cr0() & ~CR0_EM) | CR0_MP);
+    write_cr4(read_cr4() | CR4_OSFXSR | CR4_OSXMMEXCPT);
+    __asm__ volatile ("fninit");
+
+    /* Processes get the FPU on first use (fpu.c); APs copy this CR0 */
+    write_cr0(read_cr0() | CR0_TS);
+
+    if (maxleaf >= 7) {
+        cpuid(7, &a, &b, &c, &d);
+        if (b & CPUID_ERMS) {
+            serial_puts("cpu: SSE on, ERMS rep mem* routines\n");
+            return;
+        }
+    }
+    memsse2 = 1;
+    serial_puts("cpu: SSE on, SSE2 mem* routines\n");
+}
@@ -0,0 +1,297 @@
+/* edf.c - rt_set, rt_clear, rt_wait, and the EDF ready heap */
+#include "types.h"
+#include "intr.h"
+#include "clock.h"
+#include "process.h"
+#include "scheduler.h"
+#include "smp.h"
+#include "x86.h"
+
+/*
+ * An EDF process may run rtbudget ticks in each period of rtperiod
+ * ticks, and must be done rtreldl ticks after the period is released.
+ * Ready ones wait in their CPU's edfheap, earliest deadline on top,
+ * and schedule() takes from there before it looks at the priority
+ * queues, so best-effort work cannot delay them however high it has
+ * aged. Admission keeps the sum of budget / min(period, deadline) on
+ * each CPU within RT_UTILMAX, which lets EDF meet every deadline there.
+ * Budgets are charged in TSC cycles actually run, at each switch and
+ * tick. A process found at a tick with its budget used up waits in
+ * PR_RTWAIT for its next release, so an overrun costs the others at
+ * most the rest of that tick.
+ */
+
+/* Milliseconds to ticks, rounded up; split so ms * CLKHZ cannot overflow */
+static uint32_t rtticks(uint32_t ms)
+{
+    return (ms / 1000) * CLKHZ + MSTOTICKS(ms % 1000);
+}
+
+/* Share of a CPU, in 1/1000, that the parameters reserve */
+static uint32_t rtutil(uint32_t period, uint32_t budget, uint32_t reldl)
+{
+    uint32_t window = reldl < period ? reldl : period;
+
+    return (budget * 1000 + window - 1) / window;
+}
+
+/* TSC cycles in a number of ticks */
+static uint64_t rtcyc(uint32_t ticks)
+{
+    return div64((uint64_t)ticks * tsckhz() * 1000, CLKHZ);
+}
+
+/* Room on c for another process of utilization u */
+static int rtfits(struct cpu *c, uint32_t u)
+{
+    return c->nrt < NRTPROC && c->rtutil + u <= RT_UTILMAX;
+}
+
+/* If p's period is over, start the next: a fresh budget and deadline.
+ * Periods it slept through entirely are not made up. */
+static void rtrenew(struct pcb *p)
+{
+    if ((int32_t)(clkticks - (p->rtrelease + p->rtperiod)) < 0)
+        return;
+    p->rtrelease += p->rtperiod;
+    if ((int32_t)(clkticks - (p->rtrelease + p->rtperiod)) >= 0)
+        p->rtrelease = clkticks;
+    p->rtdeadline = p->rtrelease + p->rtreldl;
+    p->rtleft = rtcyc(p->rtbudget);
+}
+
+/* Take the running process p off the CPU until its next release; the
+ * caller schedules */
+static void rtpark(struct cpu *c, struct pcb *p)
+{
+    p->state = PR_RTWAIT;
+    p->qnext = c->rtwait;
+    c->rtwait = p;
+}
+
+/*------------------------------------------------------------------------
+* edfinsert - Queue a ready EDF process on c's heap, renewing its budget
+*             first if a new period has begun
+*------------------------------------------------------------------------
+*/
+void edfinsert(
+    struct cpu *c,      /* CPU that admitted it */
+    struct pcb *p       /* Process with rtperiod set */
+)
+{
+    int i = c->nedf++;
+    int up;
+
+    rtrenew(p);
+    while (i > 0) {
+        up = (i - 1) / 2;
+        if (!dlbefore(p, c->edfheap[up]))
+            break;
+        c->edfheap[i] = c->edfheap[up];
+        i = up;
+    }
+    c->edfheap[i] = p;
+}
+
+/*------------------------------------------------------------------------
+* edfpop - Dequeue the EDF process with the earliest deadline on c,
+*          or return -1 if there is none
+*------------------------------------------------------------------------
+*/
+int edfpop(
+    struct cpu *c       /* CPU to take from */
+)
+{
+    struct pcb *top, *last;
+    int i = 0, child;
+
+    if (c->nedf == 0)
+        return -1;
+
+    top = c->edfheap[0];
+    last = c->edfheap[--c->nedf];
+    while ((child = 2 * i + 1) < c->nedf) {
+        if (child + 1 < c->nedf
+                && dlbefore(c->edfheap[child + 1], c->edfheap[child]))
+            child++;
+        if (!dlbefore(c->edfheap[child], last))
+            break;
+        c->edfheap[i] = c->edfheap[child];
+        i = child;
+    }
+    c->edfheap[i] = last;
+    return top->pid;
+}
+
+/*------------------------------------------------------------------------
+* edfcharge - Take the CPU time p has run since it was last charged out
+*             of its budget
+*------------------------------------------------------------------------
+*/
+void edfcharge(
+    struct pcb *p,      /* EDF process, running until now */
+    uint64_t now        /* rdtsc() */
+)
+{
+    uint64_t used = now - p->rtstamp;
+
+    p->rtleft = used < p->rtleft ? p->rtleft - used : 0;
+    p->rtstamp = now;
+}
+
+/*------------------------------------------------------------------------
+* edftick - EDF share of a CPU's tick (clktick): release the processes
+*           whose next period has begun, charge the running one the
+*           tick, and take the CPU from it when its budget is spent or
+*           an earlier deadline is queued. A best-effort process gives
+*           way to any queued EDF process. Returns 1 if that settled
+*           the tick, 0 if the priority rules still apply.
+*------------------------------------------------------------------------
+*/
+int edftick(void)
+{
+    struct cpu *c = mycpu();
+    struct pcb *p = proctab(currpid);
+    struct pcb **pp, *q;
+
+    for (pp = &c->rtwait; (q = *pp) != NULL; ) {
+        if ((int32_t)(clkticks - (q->rtrelease + q->rtperiod)) < 0) {
+            pp = &q->qnext;
+            continue;
+        }
+        *pp = q->qnext;
+        ready(q->pid);
+    }
+
+    if (p->rtperiod == 0) {
+        if (c->nedf == 0)
+            return 0;
+        p->pflags |= PF_PREEMPT;
+        yield();
+        return 1;
+    }
+
+    /* What it ran of an old period was charged to that period */
+    edfcharge(p, rdtsc());
+    rtrenew(p);
+    if (p->rtleft == 0) {
+        p->pflags |= PF_PREEMPT;
+        rtpark(c, p);
+        schedule();
+    } else if (c->nedf > 0 && dlbefore(c->edfheap[0], p)) {
+        p->pflags |= PF_PREEMPT;
+        yield();
+    }
+    return 1;
+}
+
+/*------------------------------------------------------------------------
+* rt_set - Make the caller an EDF process, if a CPU has room for it:
+*          its own first, else the least loaded. It starts its first
+*          period at once, on that CPU, and stays there.
+*------------------------------------------------------------------------
+*/
+int rt_set(
+    uint32_t period_ms,     /* Time between releases */
+    uint32_t budget_ms,     /* CPU time it may use in each */
+    uint32_t deadline_ms    /* Done this long after release; 0: period */
+)
+{
+    intmask mask; /* Saved interrupt mask */
+    struct pcb *p = proctab(currpid);
+    uint32_t period = rtticks(period_ms);
+    uint32_t budget = rtticks(budget_ms);
+    uint32_t reldl = deadline_ms ? rtticks(deadline_ms) : period;
+    uint32_t u, oldu = 0;
+    struct cpu *c;
+
+    if (isidle(currpid) || budget == 0 || budget > reldl || reldl > period)
+        return -1;
+    u = rtutil(period, budget, reldl);
+    tsckhz();   /* Measured now, while interrupts are on */
+
+    mask = disable();
+
+    /* New parameters replace the old: weigh them without the old share */
+    if (p->rtperiod != 0) {
+        oldu = rtutil(p->rtperiod, p->rtbudget, p->rtreldl);
+        cpus[p->pcpu].rtutil -= oldu;
+        cpus[p->pcpu].nrt--;
+    }
+
+    c = &cpus[p->pcpu];
+    if (!rtfits(c, u)) {
+        c = NULL;
+        for (int i = 0; i < ncpu; i++)
+            if (rtfits(&cpus[i], u)
+                    && (c == NULL || cpus[i].rtutil < c->rtutil))
+                c = &cpus[i];
+    }
+    if (c == NULL) {
+        if (p->rtperiod != 0) {
+            cpus[p->pcpu].rtutil += oldu;
+            cpus[p->pcpu].nrt++;
+        }
+        restore(mask);
+        return -1;
+    }
+
+    c->rtutil += u;
+    c->nrt++;
+    p->pcpu = c->cpuid;
+    p->rtperiod = period;
+    p->rtbudget = budget;
+    p->rtreldl = reldl;
+    p->rtrelease = clkticks;
+    p->rtdeadline = clkticks + reldl;
+    p->rtleft = rtcyc(budget);
+    p->rtstamp = rdtsc();
+
+    /* Onto its CPU's heap, to run by deadline from now on */
+    yield();
+    restore(mask);
+    return 0;
+}
+
+/*------------------------------------------------------------------------
+* rt_clear - Return the caller to best effort at its priority, giving
+*            its CPU share back
+*------------------------------------------------------------------------
+*/
+int rt_clear(void)
+{
+    intmask mask; /* Saved interrupt mask */
+    struct pcb *p = proctab(currpid);
+
+    mask = disable();
+    if (p->rtperiod == 0) {
+        restore(mask);
+        return -1;
+    }
+    cpus[p->pcpu].rtutil -= rtutil(p->rtperiod, p->rtbudget, p->rtreldl);
+    cpus[p->pcpu].nrt--;
+    p->rtperiod = 0;
+    restore(mask);
+    return 0;
+}
+
+/*------------------------------------------------------------------------
+* rt_wait - End this period's work: give up what is left of the budget
+*           and sleep until the next release
+*------------------------------------------------------------------------
+*/
+int rt_wait(void)
+{
+    intmask mask; /* Saved interrupt mask */
+    struct pcb *p = proctab(currpid);
+
+    mask = disable();
+    if (p->rtperiod == 0) {
+        restore(mask);
+        return -1;
+    }
+    rtpark(&cpus[p->pcpu], p);
+    schedule();
+    restore(mask);
+    return 0;
+}
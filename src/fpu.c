@@ -0,0 +1,112 @@
+/* fpu.c - fputrap, fpu_switch, fpu_release: lazy FPU/SSE state */
+#include "types.h"
+#include "x86.h"
+#include "memory.h"
+#include "process.h"
+#include "intr.h"
+#include "smp.h"
+
+/* MXCSR after reset: all SIMD exceptions masked, round to nearest */
+#define MXCSR_DEFAULT   0x1F80
+
+/*
+ * CR0.TS is set whenever a process is switched in, so integer-only
+ * processes never pay for FPU state. The first FPU or SSE instruction
+ * after a switch traps (#NM) into fputrap, which loads the process's
+ * state. A process that used the FPU has it saved when it is switched
+ * out, because it may run next on another CPU; the registers keep a
+ * copy, so if it comes back to the same CPU with nobody else having
+ * loaded theirs, fputrap only clears TS.
+ */
+
+static inline void fxsave(void *area)
+{
+    __asm__ volatile ("fxsave (%0)" : : "r"(area) : "memory");
+}
+
+static inline void fxrstor(const void *area)
+{
+    __asm__ volatile ("fxrstor (%0)" : : "r"(area) : "memory");
+}
+
+/*------------------------------------------------------------------------
+* fputrap - Device-not-available (#NM): give the running process its FPU
+*           state, starting from a clean one on first use. Returns -1 if
+*           there is no FPU or no memory for the state, and the process
+*           is killed.
+*------------------------------------------------------------------------
+*/
+int fputrap(void)
+{
+    intmask mask; /* Saved interrupt mask */
+    struct cpu *c;
+    struct pcb *p;
+    uint32_t mxcsr = MXCSR_DEFAULT;
+
+    if (read_cr0() & CR0_EM)
+        return -1; /* cpu_init found no SSE: the FPU stays off */
+
+    mask = disable();
+    c = mycpu();
+    p = proctab(currpid);
+    if (p->fxarea == NULL) {
+        p->fxarea = getmem(FXSIZE);
+        if (p->fxarea == NULL) {
+            restore(mask);
+            return -1;
+        }
+        clts();
+        __asm__ volatile ("fninit\n\t"
+                          "ldmxcsr %0"
+                          : : "m"(mxcsr));
+    } else {
+        clts();
+        if (c->fpulast != currpid || p->fpucpu != c->cpuid)
+            fxrstor(p->fxarea);
+    }
+    c->fpulast = currpid;
+    p->fpucpu = c->cpuid;
+    restore(mask);
+    return 0;
+}
+
+/*------------------------------------------------------------------------
+* fpu_switch - Save old's FPU state if it used the FPU in this slice,
+*              then arm the trap for whoever runs next. Called by
+*              schedule() with the kernel lock held.
+*------------------------------------------------------------------------
+*/
+void fpu_switch(
+    int old /* Process being switched out */
+)
+{
+    uint32_t cr0 = read_cr0();
+
+    if (cr0 & CR0_TS)
+        return;
+    fxsave(proctab(old)->fxarea);
+    write_cr0(cr0 | CR0_TS);
+}
+
+/*------------------------------------------------------------------------
+* fpu_release - Drop an exiting process's FPU state
+*------------------------------------------------------------------------
+*/
+void fpu_release(
+    int pid /* The current process */
+)
+{
+    intmask mask; /* Saved interrupt mask */
+    struct pcb *p = proctab(pid);
+
+    mask = disable();
+    if (p->fxarea != NULL) {
+        /* The live registers are its: nothing to save at the switch */
+        write_cr0(read_cr0() | CR0_TS);
+        if (mycpu()->fpulast == pid)
+            mycpu()->fpulast = -1;
+        freemem(p->fxarea, FXSIZE);
+        p->fxarea = NULL;
+    }
+    restore(mask);
+}
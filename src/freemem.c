@@ -1,5 +1,6 @@
 /* freemem.c - freemem */
 #include "memory.h"
+#include "intr.h"
 #include "types.h"
 /*------------------------------------------------------------------------
 * freemem - Free a memory block, returning the block to the free list
@@ -10,59 +11,59 @@ int freemem(
     uint32_t nbytes /* Size of block in bytes */
 )
 {
-    //intmask mask; /* Saved interrupt mask */
+    intmask mask; /* Saved interrupt mask */
     struct memblk *next, *prev, *block;
-    uint32_t top;
-    //mask = disable();
-    if ((nbytes == 0) || ((uint32_t) blkaddr < (uint32_t) minheap)
-            || ((uint32_t) blkaddr > (uint32_t) maxheap))
+    uintptr_t top;
+    mask = disable();
+    if ((nbytes == 0) || ((uintptr_t)blkaddr < (uintptr_t)minheap)
+            || ((uintptr_t)blkaddr > (uintptr_t)maxheap))
     {
-        //restore(mask);
+        restore(mask);
         return -1;
     }
     nbytes = (uint32_t) roundmb(nbytes); /* Use memblk multiples */
     block = (struct memblk *)blkaddr;
-    prev = &memlist; /* Walk along free list */
-    next = memlist.mnext;
-    while ((next != NULL) && (next < block))
+    /* O(log n) neighbour lookup in the address tree */
+    mtneighbors(block, &prev, &next);
+    if (prev == NULL)   /* Compute top of previous block*/
     {
-        prev = next;
-        next = next->mnext;
-    }
-    if (prev == &memlist)   /* Compute top of previous block*/
-    {
-        top = (uint32_t) NULL;
+        top = (uintptr_t)NULL;
     }
     else
     {
-        top = (uint32_t) prev + prev->mlength;
+        top = (uintptr_t)prev + prev->mlength;
     }
     /* Ensure new block does not overlap previous or next blocks */
-    if (((prev != &memlist) && (uint32_t) block < top)
-            || ((next != NULL) && (uint32_t) block+nbytes>(uint32_t)next))
+    if (((prev != NULL) && (uintptr_t)block < top)
+            || ((next != NULL) && (uintptr_t)block+nbytes>(uintptr_t)next))
     {
-        //restore(mask);
+        restore(mask);
         return -1;
     }
     memlist.mlength += nbytes;
+    bincount[mbbin(nbytes)].nfree++;
+    MEMUNUSE(nbytes);
     /* Either coalesce with previous block or add to free list */
-    if (top == (uint32_t) block)   /* Coalesce with previous block */
+    if ((prev != NULL) && top == (uintptr_t)block)   /* Coalesce with previous block */
     {
+        mbremove(prev);
         prev->mlength += nbytes;
         block = prev;
     }
-    else     /* Link into list as new node */
+    else     /* Link into tree as new node */
     {
-        block->mnext = next;
         block->mlength = nbytes;
-        prev->mnext = block;
+        mtinsert(block);
     }
     /* Coalesce with next block if adjacent */
-    if (((uint32_t) block + block->mlength) == (uint32_t) next)
+    if ((next != NULL) && ((uintptr_t)block + block->mlength) == (uintptr_t)next)
     {
+        mbremove(next);
+        mtremove(next);
         block->mlength += next->mlength;
-        block->mnext = next->mnext;
     }
-    //restore(mask);
+    mtresize(block);
+    mbinsert(block);
+    restore(mask);
     return 0;
 }
@@ -0,0 +1,86 @@
+/* gdt.c - Flat segments and the per-CPU task state and data segments */
+#include "types.h"
+#include "x86.h"
+#include "smp.h"
+
+struct segdesc {
+    uint16_t limit_lo;
+    uint16_t base_lo;
+    uint8_t  base_mid;
+    uint8_t  access;
+    uint8_t  flags_limit_hi;
+    uint8_t  base_hi;
+} __attribute__((packed));
+
+/* Null, code, data, then TSS, PFTSS and CPU data for each CPU */
+static struct segdesc gdt[3 + 3 * NCPU];
+
+static void set_seg(int i, uint32_t base, uint32_t limit, uint8_t access,
+                    uint8_t flags)
+{
+    gdt[i].limit_lo = limit & 0xFFFF;
+    gdt[i].base_lo = base & 0xFFFF;
+    gdt[i].base_mid = (base >> 16) & 0xFF;
+    gdt[i].access = access;
+    gdt[i].flags_limit_hi = (flags & 0xF0) | ((limit >> 16) & 0x0F);
+    gdt[i].base_hi = (base >> 24) & 0xFF;
+}
+
+/* Initialise the GDT for every CPU, then load it on this (the boot) CPU */
+void gdt_init(void)
+{
+    set_seg(0, 0, 0, 0, 0);
+    set_seg(1, 0, 0xFFFFF, 0x9A, 0xC0);     /* SEG_KCODE */
+    set_seg(2, 0, 0xFFFFF, 0x92, 0xC0);     /* SEG_KDATA */
+
+    for (int i = 0; i < NCPU; i++) {
+        struct cpu *c = &cpus[i];
+
+        set_seg(SEG_TSS(i) / 8, (uint32_t)&c->tss,
+                sizeof(struct tss) - 1, 0x89, 0x00);
+        set_seg(SEG_PFTSS(i) / 8, (uint32_t)&c->pftss,
+                sizeof(struct tss) - 1, 0x89, 0x00);
+        set_seg(SEG_CPU(i) / 8, (uint32_t)c,
+                sizeof(struct cpu) - 1, 0x92, 0x40);
+
+        /* No I/O permission bitmaps */
+        c->tss.iomap = sizeof(struct tss);
+        c->pftss.iomap = sizeof(struct tss);
+        c->self = c;
+        c->cpuid = i;
+    }
+    gdt_initcpu(0);
+}
+
+/*------------------------------------------------------------------------
+* gdt_initcpu - Load the GDT, the flat segments, this CPU's %fs and TR
+*------------------------------------------------------------------------
+*/
+void gdt_initcpu(
+    int cpu /* Index in cpus[] */
+)
+{
+    struct {
+        uint16_t limit;
+        uint32_t base;
+    } __attribute__((packed)) gdtr;
+
+    gdtr.limit = sizeof(gdt) - 1;
+    gdtr.base = (uint32_t)gdt;
+    __asm__ volatile (
+        "lgdt %0\n\t"
+        "ljmp %1, $1f\n"
+        "1:\n\t"
+        "movw %2, %%ax\n\t"
+        "movw %%ax, %%ds\n\t"
+        "movw %%ax, %%es\n\t"
+        "movw %%ax, %%gs\n\t"
+        "movw %%ax, %%ss\n\t"
+        "movw %w3, %%ax\n\t"
+        "movw %%ax, %%fs\n\t"
+        "movw %w4, %%ax\n\t"
+        "ltr %%ax"
+        : : "m"(gdtr), "i"(SEG_KCODE), "i"(SEG_KDATA),
+            "r"(SEG_CPU(cpu)), "r"(SEG_TSS(cpu))
+        : "eax", "memory");
+}
@@ -1,6 +1,7 @@
 /* getmem.c - getmem */
 #include "types.h"
 #include "memory.h"
+#include "intr.h"
 /*------------------------------------------------------------------------
 * getmem - Allocate heap storage, returning lowest word address
 *------------------------------------------------------------------------
@@ -9,47 +10,72 @@ void *getmem(
     uint32_t nbytes /* Size of memory requested */
 )
 {
-    //intmask mask; /* Saved interrupt mask */
-    struct memblk *prev, *curr, *leftover;
-    struct memblk *best = NULL;
-    struct memblk *best_prev = NULL;
-    //mask = disable();
+    intmask mask; /* Saved interrupt mask */
+    struct memblk *best, *leftover;
+    mask = disable();
     if (nbytes == 0)
     {
-        //restore(mask);
+        restore(mask);
         return NULL;
     }
     nbytes = (uint32_t) roundmb(nbytes); /* Use memblk multiples */
-    prev = &memlist;
-    curr = memlist.mnext;
-        while (curr != NULL) {
-        if (curr->mlength >= nbytes) {
-            if (best == NULL || curr->mlength < best->mlength) {
-                best = curr;
-                best_prev = prev;
-            }
-        }
-        prev = curr;
-        curr = curr->mnext;
-    }
+
+    /* Size-class lookup instead of a full-list scan */
+    best = mbfind(nbytes);
+    if (best == NULL && memgrow(nbytes) == 0)
+        best = mbfind(nbytes);
         /* No suitable block found */
-    if (best == NULL)
+    if (best == NULL) {
+        bincount[mbbin(nbytes)].nfail++;
+        restore(mask);
         return NULL;
+    }
+
+    mbremove(best);
 
     /* Exact fit */
     if (best->mlength == nbytes) {
-        best_prev->mnext = best->mnext;
+        mtremove(best);
     }
-    /* Split block */
+    /* Split block: the leftover keeps best's place in address order */
     else {
         leftover = (struct memblk *)((char *)best + nbytes);
         leftover->mlength = best->mlength - nbytes;
-        leftover->mnext = best->mnext;
-
-        best_prev->mnext = leftover;
+        mtreplace(best, leftover);
+        mtresize(leftover);
+        mbinsert(leftover);
     }
 
     memlist.mlength -= nbytes;
+    bincount[mbbin(nbytes)].nalloc++;
+    MEMUSE(nbytes);
 
+    restore(mask);
     return (void *)best;
 }
+
+/*------------------------------------------------------------------------
+* memgrow - Add a page block of at least nbytes to the heap free list
+*------------------------------------------------------------------------
+*/
+int memgrow(
+    uint32_t nbytes /* Size the heap must be able to satisfy */
+)
+{
+    int order = pgorder(nbytes);
+    void *blk;
+
+    if (order < HEAPGROW_ORDER)
+        order = HEAPGROW_ORDER;
+    if (((uint32_t)PAGE_SIZE << order) < nbytes)
+        return -1; /* Larger than the biggest page block */
+
+    blk = alloc_pages(order);
+    if (blk == NULL)
+        return -1;
+    if (freemem(blk, (uint32_t)PAGE_SIZE << order) != 0)
+        return -1;
+    /* Growth is not a caller's free: keep the size-class counts clean */
+    bincount[mbbin((uint32_t)PAGE_SIZE << order)].nfree--;
+    return 0;
+}
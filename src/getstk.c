@@ -1,5 +1,6 @@
 /* getstk.c - getstk */
 #include "memory.h"
+#include "intr.h"
 #include "types.h"
 /*------------------------------------------------------------------------
 * getstk - Allocate stack memory, returning highest word address
@@ -9,45 +10,41 @@ void *getstk(
     uint32_t nbytes /* Size of memory requested */
 )
 {
-    //intmask mask; /* Saved interrupt mask */
-    struct memblk *prev, *curr; /* Walk through memory list */
-    struct memblk *fits, *fitsprev; /* Record block that fits */
-    //mask = disable();
+    intmask mask; /* Saved interrupt mask */
+    struct memblk *fits; /* Record block that fits */
+    mask = disable();
     if (nbytes == 0)
     {
-        //restore(mask);
+        restore(mask);
         return NULL;
     }
     nbytes = (uint32_t) roundmb(nbytes); /* Use mblock multiples */
-    prev = &memlist;
-    curr = memlist.mnext;
-    fits = NULL;
-    fitsprev = NULL; /* Just to avoid a compiler warning */
-    while (curr != NULL)   /* Scan entire list */
+    fits = mthighest(nbytes); /* Highest block that fits */
+    if (fits == NULL && memgrow(nbytes) == 0)
     {
-        if (curr->mlength >= nbytes)   /* Record block address */
-        {
-            fits = curr; /* when request fits */
-            fitsprev = prev;
-        }
-        prev = curr;
-        curr = curr->mnext;
+        fits = mthighest(nbytes);
     }
     if (fits == NULL)   /* No block was found */
     {
-        //restore(mask);
+        bincount[mbbin(nbytes)].nfail++;
+        restore(mask);
         return NULL;
     }
+    mbremove(fits);
     if (nbytes == fits->mlength)   /* Block is exact match */
     {
-        fitsprev->mnext = fits->mnext;
+        mtremove(fits);
     }
     else     /* Remove top section */
     {
         fits->mlength -= nbytes;
-        fits = (struct memblk *)((uint32_t)fits + fits->mlength);
+        mtresize(fits);
+        mbinsert(fits);
+        fits = (struct memblk *)((uintptr_t)fits + fits->mlength);
     }
     memlist.mlength -= nbytes;
-    //restore(mask);
-    return (void *)((uint32_t) fits + nbytes - sizeof(uint32_t));
+    bincount[mbbin(nbytes)].nalloc++;
+    MEMUSE(nbytes);
+    restore(mask);
+    return (void *)((uintptr_t)fits + nbytes - sizeof(uint32_t));
 }
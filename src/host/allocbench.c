@@ -0,0 +1,337 @@
+/* allocbench.c - Host-side benchmark for the kacchiOS memory manager
+ *
+ * Builds meminit/getmem/freemem/getstk natively (see the bench-alloc
+ * target in the Makefile) over a malloc'd arena and replays allocation
+ * traces against them, reporting throughput, worst-case latency and
+ * the fragmentation left behind.
+ *
+ * Usage: allocbench [-n ops] [-m arena_mb] [-g workload] [trace ...]
+ *
+ *   With no trace files, every built-in synthetic workload is run.
+ *   -g writes the named synthetic workload to stdout as a trace file.
+ *
+ * Latencies are wall-clock per operation and include the cost of
+ * clock_gettime itself, so treat them as upper bounds.
+ *
+ * Trace format, one operation per line ('#' starts a comment):
+ *   a <id> <bytes>    getmem
+ *   f <id>            freemem of block <id>
+ *   s <id> <bytes>    getstk
+ *   x <id>            freestk of stack <id>
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "types.h"
+#include "memory.h"
+
+#define MAXLIVE  8192       /* Ids a trace may have live at once */
+
+struct op {
+    char kind;              /* 'a', 'f', 's' or 'x' */
+    uint32_t id;
+    uint32_t size;
+};
+
+struct trace {
+    struct op *ops;
+    uint32_t nops;
+    uint32_t cap;
+};
+
+/* memstat.c prints through the serial driver; send it to stdout */
+void serial_puts(const char *str) { fputs(str, stdout); }
+void serial_putdec(uint32_t val) { printf("%u", val); }
+
+/* -----------------------------
+ * Synthetic workloads
+ * ----------------------------- */
+
+static uint32_t seed = 12345;
+
+static uint32_t rnd(void)
+{
+    seed = seed * 1103515245 + 12345;
+    return seed >> 8;
+}
+
+static uint32_t rndrange(uint32_t lo, uint32_t hi)
+{
+    return lo + rnd() % (hi - lo + 1);
+}
+
+static void push(struct trace *t, char kind, uint32_t id, uint32_t size)
+{
+    if (t->nops == t->cap) {
+        t->cap = t->cap ? t->cap * 2 : 4096;
+        t->ops = realloc(t->ops, t->cap * sizeof(struct op));
+        if (t->ops == NULL) {
+            perror("realloc");
+            exit(1);
+        }
+    }
+    t->ops[t->nops].kind = kind;
+    t->ops[t->nops].id = id;
+    t->ops[t->nops].size = size;
+    t->nops++;
+}
+
+enum { W_UNIFORM, W_BIMODAL, W_STACK, W_LONGSHORT, NWORKLOAD };
+
+static const char *wname[NWORKLOAD] = {
+    "uniform", "bimodal", "stack", "longshort"
+};
+
+/* Size of the next allocation for a workload; *stk set for getstk */
+static uint32_t wsize(int w, int *stk)
+{
+    *stk = 0;
+    switch (w) {
+    case W_UNIFORM:
+        return rndrange(1, 4096);
+    case W_BIMODAL:
+        return (rnd() % 10) ? rndrange(16, 128) : rndrange(16384, 65536);
+    case W_STACK:
+        if (rnd() % 4) {
+            *stk = 1;
+            return rndrange(1, 4) * 4096;
+        }
+        return rndrange(16, 512);
+    default:
+        return rndrange(16, 2048);
+    }
+}
+
+/*
+ * Generate nops operations, keeping between a quarter of and all of
+ * MAXLIVE ids live. Frees pick a random live block, except in
+ * longshort, which frees in allocation order and pins one allocation
+ * in ten (under ids MAXLIVE and up) for the whole run.
+ */
+static void synth(struct trace *t, int w, uint32_t nops)
+{
+    static uint32_t live[MAXLIVE], freeids[MAXLIVE];
+    static char kind[2 * MAXLIVE];
+    uint32_t nlive = 0, head = 0, nfreeid = 0, nlong = 0;
+
+    for (uint32_t i = 0; i < MAXLIVE; i++)
+        freeids[nfreeid++] = MAXLIVE - 1 - i;
+    seed = 12345 + w;
+
+    while (t->nops < nops) {
+        int alloc = nfreeid > 0 && (nlive < MAXLIVE / 4 || rnd() % 2);
+
+        if (alloc) {
+            int stk;
+            uint32_t sz = wsize(w, &stk), id;
+
+            if (w == W_LONGSHORT && nlong < MAXLIVE && rnd() % 10 == 0) {
+                id = MAXLIVE + nlong++;
+            } else {
+                id = freeids[--nfreeid];
+                live[(head + nlive) % MAXLIVE] = id;
+                nlive++;
+            }
+            kind[id] = stk ? 's' : 'a';
+            push(t, kind[id], id, sz);
+        } else {
+            uint32_t i = (w == W_LONGSHORT) ? 0 : rnd() % nlive;
+            uint32_t slot = (head + i) % MAXLIVE;
+            uint32_t id = live[slot];
+
+            push(t, kind[id] == 's' ? 'x' : 'f', id, 0);
+            /* Fill the hole with the oldest entry and drop the head */
+            live[slot] = live[head];
+            head = (head + 1) % MAXLIVE;
+            nlive--;
+            freeids[nfreeid++] = id;
+        }
+    }
+}
+
+/* -----------------------------
+ * Trace files
+ * ----------------------------- */
+
+static int load(struct trace *t, const char *path)
+{
+    FILE *f = fopen(path, "r");
+    char line[128];
+    int lineno = 0;
+
+    if (f == NULL) {
+        perror(path);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), f) != NULL) {
+        char kind;
+        unsigned id, size = 0;
+
+        lineno++;
+        if (line[0] == '#' || line[0] == '\n')
+            continue;
+        if (sscanf(line, " %c %u %u", &kind, &id, &size) < 2
+                || strchr("afsx", kind) == NULL || id >= 2 * MAXLIVE) {
+            fprintf(stderr, "%s:%d: bad trace line\n", path, lineno);
+            fclose(f);
+            return -1;
+        }
+        push(t, kind, id, size);
+    }
+    fclose(f);
+    return 0;
+}
+
+static void dump(struct trace *t)
+{
+    for (uint32_t i = 0; i < t->nops; i++) {
+        struct op *o = &t->ops[i];
+        if (o->kind == 'a' || o->kind == 's')
+            printf("%c %u %u\n", o->kind, o->id, o->size);
+        else
+            printf("%c %u\n", o->kind, o->id);
+    }
+}
+
+/* -----------------------------
+ * Replay
+ * ----------------------------- */
+
+static uint64_t nsnow(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void replay(const char *name, struct trace *t, void *arena,
+                   size_t arenasize)
+{
+    static void *ptr[2 * MAXLIVE];
+    static uint32_t len[2 * MAXLIVE];
+    struct memrange range;
+    struct memstat ms;
+    uint64_t total = 0, worst = 0;
+    uint32_t fails = 0, done = 0;
+
+    range.mrstart = (uintptr_t)arena;
+    range.mrend = (uintptr_t)arena + arenasize;
+    meminit(&range, 1);
+    memset(ptr, 0, sizeof(ptr));
+
+    for (uint32_t i = 0; i < t->nops; i++) {
+        struct op *o = &t->ops[i];
+        uint64_t t0, dt;
+        void *p;
+
+        switch (o->kind) {
+        case 'a':
+        case 's':
+            if (ptr[o->id] != NULL)
+                continue; /* Trace reuses a live id: skip */
+            t0 = nsnow();
+            p = (o->kind == 'a') ? getmem(o->size) : getstk(o->size);
+            dt = nsnow() - t0;
+            if (p == NULL) {
+                fails++;
+                continue;
+            }
+            ptr[o->id] = p;
+            len[o->id] = o->size;
+            break;
+        default:
+            if (ptr[o->id] == NULL)
+                continue; /* Its allocation failed */
+            t0 = nsnow();
+            if (o->kind == 'f')
+                freemem(ptr[o->id], len[o->id]);
+            else
+                freestk(ptr[o->id], len[o->id]);
+            dt = nsnow() - t0;
+            ptr[o->id] = NULL;
+            break;
+        }
+        total += dt;
+        if (dt > worst)
+            worst = dt;
+        done++;
+    }
+
+    /* Fragmentation is measured with the survivors still allocated */
+    memstat(&ms);
+    printf("%-12s %9u %8.2f %9llu %6u %9u %8u %10u %10u\n",
+           name, done, total ? done * 1000.0 / total : 0.0,
+           (unsigned long long)worst, fails, ms.ms_frag, memnblk,
+           ms.ms_heapfree, ms.ms_peak);
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t nops = 1000000;
+    size_t arenasize = 64u << 20;
+    const char *gen = NULL;
+    void *arena;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:m:g:")) != -1) {
+        switch (opt) {
+        case 'n':
+            nops = strtoul(optarg, NULL, 0);
+            break;
+        case 'm':
+            arenasize = strtoul(optarg, NULL, 0) << 20;
+            break;
+        case 'g':
+            gen = optarg;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n ops] [-m arena_mb] "
+                    "[-g workload] [trace ...]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    if (gen != NULL) {
+        struct trace t = { 0 };
+        for (int w = 0; w < NWORKLOAD; w++) {
+            if (strcmp(gen, wname[w]) == 0) {
+                synth(&t, w, nops);
+                dump(&t);
+                return 0;
+            }
+        }
+        fprintf(stderr, "unknown workload '%s'\n", gen);
+        return 2;
+    }
+
+    arena = malloc(arenasize);
+    if (arena == NULL) {
+        perror("malloc");
+        return 1;
+    }
+    memset(arena, 0, arenasize); /* Fault it in before timing anything */
+
+    printf("%-12s %9s %8s %9s %6s %9s %8s %10s %10s\n",
+           "trace", "ops", "Mops/s", "worst_ns", "fails", "frag/1000",
+           "freeblks", "heapfree", "peak");
+    if (optind == argc) {
+        for (int w = 0; w < NWORKLOAD; w++) {
+            struct trace t = { 0 };
+            synth(&t, w, nops);
+            replay(wname[w], &t, arena, arenasize);
+            free(t.ops);
+        }
+    }
+    for (int i = optind; i < argc; i++) {
+        struct trace t = { 0 };
+        if (load(&t, argv[i]) != 0)
+            return 1;
+        replay(argv[i], &t, arena, arenasize);
+        free(t.ops);
+    }
+    free(arena);
+    return 0;
+}
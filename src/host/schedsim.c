@@ -0,0 +1,1034 @@
+/* schedsim.c - Host-side simulator for the kacchiOS scheduler
+ *
+ * Builds scheduler.c, process.c, mailbox.c, sync.c, the timing wheel
+ * and the memory manager natively (see the bench-sched target in the Makefile)
+ * and runs scripted workloads on one simulated CPU, at as many
+ * processes as NPROC allows. Each process runs on a ucontext of its
+ * own: ctx_switch below swaps contexts instead of stacks. Time is
+ * virtual. rdtsc() returns a 1 GHz cycle count that only moves when a
+ * process does work (simrun) or the kernel switches (-c cycles each),
+ * and every CLKHZ-th of a second of it runs the tick handler, which
+ * preempts just as the PIT would. The kernel's own accounting
+ * (pstat.c) therefore measures virtual time.
+ *
+ * Usage: schedsim [-d seconds] [-c switch_cycles] [-t starve_ms]
+ *                 [-g workload] [script ...]
+ *        schedsim -k
+ *
+ *   With no scripts, every built-in workload is run.
+ *   -g writes the named built-in workload to stdout as a script.
+ *   -k runs the checks instead (make check-sim): each asserts what a
+ *   kernel primitive promises, on a fresh simulated kernel, and the
+ *   exit status is 1 at the first that fails.
+ *
+ * Script format, one process group per line ('#' starts a comment):
+ *   cpu   <n> <prio> <work_us>             compute forever
+ *   yield <n> <prio> <work_us>             compute, then yield()
+ *   burst <n> <prio> <work_us> <sleep_ms>  compute, then sleep
+ *   ipc   <n> <prio> <work_us> <serve_us>  n client/server pairs: the
+ *                                          client computes, then
+ *                                          sendrecv()s to its server,
+ *                                          which computes a reply
+ *   sr    <n> <prio> <work_us> <serve_us>  as ipc, with each side
+ *                                          calling send() and then
+ *                                          receive() instead
+ *   rt    <n> <period_ms> <budget_ms> <work_us>
+ *                                          EDF processes (edf.c): each
+ *                                          period, compute, then
+ *                                          rt_wait(); those admission
+ *                                          control refuses exit
+ *
+ * For each group it reports work done per virtual second, CPU share,
+ * Jain's fairness index over the group's CPU time, mean time spent
+ * ready, the longest single wait on the ready queue, how many
+ * processes ever waited longer than -t (starved) or never ran at all,
+ * and what aging did: promotions seen at dispatch, and how many
+ * processes end above the priority they started at. EDF groups also
+ * report admissions and deadline misses.
+ */
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <ucontext.h>
+
+#include "types.h"
+#include "memory.h"
+#include "process.h"
+#include "scheduler.h"
+#include "clock.h"
+#include "smp.h"
+#include "sync.h"
+
+#define VHZ         1000000000ull       /* Virtual TSC rate */
+#define TICKCYC     (VHZ / CLKHZ)
+#define USCYC       (VHZ / 1000000)
+#define HOSTSTK     (32 * 1024)         /* Real stack per process */
+#define MAXGROUP    64
+#define ARENA       (256u << 20)
+
+/* -----------------------------
+ * Kernel stubs: one CPU, no devices
+ * ----------------------------- */
+
+struct cpu cpus[NCPU];
+int ncpu = 1;
+
+void serial_puts(const char *str) { fputs(str, stdout); }
+void serial_putc(char c) { putchar(c); }
+void serial_putdec(uint32_t val) { printf("%u", val); }
+void serial_puthex32(uint32_t val) { printf("0x%08X", val); }
+void set_irq_handler(int irq, void (*handler)(void)) { (void)irq; (void)handler; }
+void ipi_broadcast(int vec) { (void)vec; }
+void vmrefill(void) { }
+void vmtlbsync(void) { }
+int vmmapped(void *va) { (void)va; return 1; }
+int vmstkreset(void *stktop) { (void)stktop; return 0; }
+void fpu_switch(int old) { (void)old; }
+void fpu_release(int pid) { (void)pid; }
+
+int getcurrpid(void)
+{
+    return cpus[0].runpid;
+}
+
+/* -----------------------------
+ * Virtual time
+ * ----------------------------- */
+
+static uint64_t vnow;           /* Cycles since the simulation began */
+static uint64_t nexttick = TICKCYC;
+static uint64_t vend;           /* Stop here */
+static uint64_t swcost = 2000;  /* Cycles charged per context switch */
+
+uint64_t rdtsc(void)
+{
+    return vnow;
+}
+
+uint32_t hosttsckhz(void)
+{
+    return VHZ / 1000;
+}
+
+static void report(void);
+static const char *checking;    /* Check running under -k, or NULL */
+
+/* Do cycles of work as the current process; ticks fall due on the way */
+static void simrun(uint64_t cycles)
+{
+    uint64_t step;
+
+    while (cycles > 0 || vnow >= nexttick) {
+        step = (nexttick > vnow) ? nexttick - vnow : 0;
+        if (step > cycles)
+            step = cycles;
+        vnow += step;
+        cycles -= step;
+        if (vnow >= nexttick) {
+            nexttick += TICKCYC;
+            if (vnow >= vend) {
+                if (checking != NULL) {
+                    printf("check %s: FAIL: still running after %.1f "
+                           "virtual s\n", checking, (double)vend / VHZ);
+                    exit(1);
+                }
+                report();
+                exit(0);
+            }
+            clkhandler();   /* May switch away; we resume here */
+        }
+    }
+}
+
+/* -----------------------------
+ * Contexts: ctx_switch on ucontext
+ * ----------------------------- */
+
+struct hctx {
+    ucontext_t uc;
+    int pid;
+    void (*entry)(void *);
+    void *arg;
+    void *stack;
+    struct hctx *next;          /* Free list */
+};
+
+static struct hctx mainctx;     /* NULLPROC: main() itself */
+static struct hctx *cur = &mainctx;
+static struct hctx *dead;       /* Exited; recycle once off its stack */
+static struct hctx *ctxfree;
+
+static void switchin(int pid);
+
+static void reap(void)
+{
+    if (dead != NULL) {
+        dead->next = ctxfree;
+        ctxfree = dead;
+        dead = NULL;
+    }
+}
+
+static void hoststart(void)
+{
+    reap();
+    cur->entry(cur->arg);
+    process_exit();
+}
+
+uint32_t *hostctx(int pid, void (*entry)(void *), void *arg)
+{
+    struct hctx *h = ctxfree;
+
+    if (h != NULL) {
+        ctxfree = h->next;
+    } else {
+        h = calloc(1, sizeof(*h));
+        if (h == NULL || (h->stack = malloc(HOSTSTK)) == NULL) {
+            perror("malloc");
+            exit(1);
+        }
+    }
+    h->pid = pid;
+    h->entry = entry;
+    h->arg = arg;
+    getcontext(&h->uc);
+    h->uc.uc_stack.ss_sp = h->stack;
+    h->uc.uc_stack.ss_size = HOSTSTK;
+    h->uc.uc_link = NULL;
+    makecontext(&h->uc, hoststart, 0);
+    return (uint32_t *)h;
+}
+
+void ctx_switch(uint32_t **old_sp, uint32_t *new_sp)
+{
+    struct hctx *o = cur;
+    struct hctx *n = (struct hctx *)new_sp;
+
+    *old_sp = (uint32_t *)o;
+    if (proctab(o->pid)->state == PR_FREE)
+        dead = o;
+    vnow += swcost;
+    switchin(n->pid);
+    cur = n;
+    swapcontext(&o->uc, &n->uc);
+    reap();
+}
+
+/* -----------------------------
+ * Workloads
+ * ----------------------------- */
+
+enum { K_CPU, K_YIELD, K_BURST, K_IPC, K_SR, K_RT, NKIND };
+static const char *kname[] = { "cpu", "yield", "burst", "ipc", "sr", "rt" };
+
+struct group {
+    int kind;
+    int n;
+    int prio;
+    uint64_t work;              /* Cycles per unit of work */
+    uint32_t extra;             /* burst: sleep ms; ipc, sr: serve us */
+    uint32_t period, budget;    /* rt: EDF parameters, ms */
+    int nreject;                /* rt: refused by admission control */
+    uint32_t nmiss;             /* rt: jobs done after their deadline */
+};
+
+/* What the simulator knows about each process */
+struct sproc {
+    int group;                  /* Index in groups[], or -1: server */
+    int peer;                   /* ipc, sr: the other end */
+    uint64_t ops;               /* Units of work finished */
+    uint64_t lastready;         /* pcount.readycyc when last dispatched */
+    uint64_t maxwait;           /* Longest single wait on the queue */
+    uint32_t nstarve;           /* Waits longer than starvecyc */
+    int prio;                   /* Priority when last dispatched */
+    uint32_t promos;            /* Aging promotions seen */
+};
+
+static struct group groups[MAXGROUP];
+static int ngroup;
+static struct sproc *sprocs[NPROC];
+static uint64_t starvecyc = 1000 * (VHZ / 1000);
+
+/* Bookkeeping as pid gets the CPU: its wait, and any aging */
+static void switchin(int pid)
+{
+    struct sproc *s = sprocs[pid];
+    uint64_t wait;
+
+    if (s == NULL)
+        return;
+    wait = proctab(pid)->pcount.readycyc - s->lastready;
+    s->lastready = proctab(pid)->pcount.readycyc;
+    if (wait > s->maxwait)
+        s->maxwait = wait;
+    if (wait > starvecyc)
+        s->nstarve++;
+    if (proctab(pid)->priority > s->prio) {
+        s->promos += proctab(pid)->priority - s->prio;
+        s->prio = proctab(pid)->priority;
+    }
+}
+
+static void cpuproc(void *arg)
+{
+    struct sproc *s = arg;
+    struct group *g = &groups[s->group];
+
+    for (;;) {
+        simrun(g->work);
+        s->ops++;
+        if (g->kind == K_YIELD)
+            yield();
+        else if (g->kind == K_BURST)
+            sleep_ms(g->extra);
+    }
+}
+
+static void rtproc(void *arg)
+{
+    struct sproc *s = arg;
+    struct group *g = &groups[s->group];
+    struct pcb *self = proctab(getpid());
+
+    if (rt_set(g->period, g->budget, 0) != 0) {
+        g->nreject++;
+        return;
+    }
+    for (;;) {
+        simrun(g->work);
+        s->ops++;
+        if ((int32_t)(clkticks - self->rtdeadline) > 0)
+            g->nmiss++;
+        rt_wait();
+    }
+}
+
+/* One round trip's half: a message to peer, then the one back. sr
+ * groups make the two calls sendrecv() combines. */
+static void ipcxchg(struct group *g, int peer, msg_t out, msg_t *in)
+{
+    if (g->kind == K_SR) {
+        send(peer, out);
+        receive(in);
+    } else {
+        sendrecv(peer, out, in);
+    }
+}
+
+static void ipcclient(void *arg)
+{
+    struct sproc *s = arg;
+    struct group *g = &groups[s->group];
+    msg_t m;
+
+    for (;;) {
+        simrun(g->work);
+        ipcxchg(g, s->peer, 1, &m);
+        s->ops++;
+    }
+}
+
+static void ipcserver(void *arg)
+{
+    struct sproc *s = arg;
+    struct group *g = &groups[sprocs[s->peer]->group];
+    msg_t m;
+
+    receive(&m);
+    for (;;) {
+        simrun((uint64_t)g->extra * USCYC);
+        ipcxchg(g, s->peer, m, &m);
+    }
+}
+
+static struct sproc *spawn(void (*entry)(void *), const char *name,
+                           int prio, int group)
+{
+    struct sproc *s = calloc(1, sizeof(*s));
+    int pid;
+
+    if (s == NULL) {
+        perror("calloc");
+        exit(1);
+    }
+    s->group = group;
+    s->prio = prio;
+    pid = process_create_ex(entry, name, 0, prio, s);
+    if (pid < 0) {
+        fprintf(stderr, "schedsim: process_create_ex failed after %d "
+                "processes\n", npid);
+        exit(1);
+    }
+    sprocs[pid] = s;
+    return s;
+}
+
+static void startgroup(int gi)
+{
+    struct group *g = &groups[gi];
+    struct sproc *c, *sv;
+
+    for (int i = 0; i < g->n; i++) {
+        if (g->kind == K_RT) {
+            /* Above everything, so each gets to rt_set() at once */
+            spawn(rtproc, "rt", g->prio, gi);
+            continue;
+        }
+        if (g->kind != K_IPC && g->kind != K_SR) {
+            spawn(cpuproc, kname[g->kind], g->prio, gi);
+            continue;
+        }
+        /* Neither runs before both know the other's PID */
+        sv = spawn(ipcserver, "server", g->prio, -1);
+        c = spawn(ipcclient, "client", g->prio, gi);
+        for (int pid = 0; pid < npid; pid++) {
+            if (sprocs[pid] == sv)
+                c->peer = pid;
+            else if (sprocs[pid] == c)
+                sv->peer = pid;
+        }
+    }
+}
+
+/* -----------------------------
+ * Checks (-k)
+ * -----------------------------
+ * Each check is a process at CKPRIO on a kernel of its own. It starts
+ * helpers above or below itself to force the interleaving it wants,
+ * asserts with CK, and ends the simulation with ckpass(). A check that
+ * deadlocks fails when the virtual time runs out.
+ */
+
+#define CKPRIO      4
+
+static int ckpid;                       /* The check's own process */
+static msg_t ckbuf[4 * MBOXDEPTH];      /* What cksink received */
+static int ckn;                         /* Messages in ckbuf */
+
+static void ckfail(const char *fmt, ...)
+{
+    va_list ap;
+
+    printf("check %s: FAIL: ", checking);
+    va_start(ap, fmt);
+    vprintf(fmt, ap);
+    va_end(ap);
+    putchar('\n');
+    exit(1);
+}
+
+#define CK(cond) \
+    do { if (!(cond)) ckfail("%s, line %d", #cond, __LINE__); } while (0)
+
+static void ckpass(void)
+{
+    printf("check %s: ok\n", checking);
+    exit(0);
+}
+
+static int ckspawn(void (*entry)(void *), int prio, void *arg)
+{
+    int pid = process_create_ex(entry, "check", 0, prio, arg);
+
+    CK(pid >= 0);
+    return pid;
+}
+
+static void cknop(void *arg)
+{
+    (void)arg;
+}
+
+/* Receive (intptr_t)arg messages into ckbuf, at most five at a time,
+ * then tell the check */
+static void cksink(void *arg)
+{
+    int want = (int)(intptr_t)arg;
+    int k;
+
+    while (ckn < want) {
+        k = receiven(&ckbuf[ckn], want - ckn < 5 ? want - ckn : 5);
+        CK(k > 0 && k <= 5);
+        ckn += k;
+    }
+    CK(send(ckpid, 0) == 0);
+}
+
+/* Answer each message with itself */
+static void ckecho(void *arg)
+{
+    msg_t m;
+
+    (void)arg;
+    if (receive(&m) != 0)
+        return;
+    while (sendrecv(ckpid, m, &m) == 0)
+        ;
+}
+
+static int ckvpid;      /* Receiver that exits under a parked sender */
+
+/* Once the check is parked on our full mailbox, wake ckreuse and exit */
+static void ckvictim(void *arg)
+{
+    sleep_ms(1);
+    CK(proctab(ckpid)->state == PR_SEND);
+    CK(trysend((int)(intptr_t)arg, 0) == 0);
+}
+
+/* Create processes until one is given the victim's PID. They sit
+ * below the check, so the check wakes to find that one's mailbox. */
+static void ckreuse(void *arg)
+{
+    msg_t m;
+
+    (void)arg;
+    CK(receive(&m) == 0);
+    CK(proctab(ckvpid)->state == PR_FREE);
+    while (ckspawn(cknop, CKPRIO - 2, NULL) != ckvpid)
+        ;
+}
+
+/* Mailboxes: trysend, sendn, receiven, sendrecv and a reused PID */
+static void ckmbox(void *arg)
+{
+    msg_t msgs[3 * MBOXDEPTH + 1];
+    msg_t m;
+    int pid, n;
+
+    (void)arg;
+    ckpid = getpid();
+
+    /* Errors are told apart from messages; -1 is a message */
+    CK(receive(NULL) == -1);
+    CK(sendrecv(ckpid, 1, &m) == -1);
+    CK(send(NPROC, 1) == -1 && trysend(-1, 1) == -1);
+
+    /* trysend fills the mailbox, then refuses without blocking */
+    ckn = 0;
+    pid = ckspawn(cksink, CKPRIO - 1, (void *)(intptr_t)MBOXDEPTH);
+    for (int i = 0; i < MBOXDEPTH; i++)
+        CK(trysend(pid, i - 1) == 0);
+    CK(trysend(pid, MBOXDEPTH) == -1);
+    CK(receive(&m) == 0 && m == 0);
+    for (int i = 0; i < MBOXDEPTH; i++)
+        CK(ckbuf[i] == i - 1);
+
+    /* sendn parks on the full mailbox and resumes as receiven drains
+     * it five at a time; order is kept throughout */
+    n = 3 * MBOXDEPTH + 1;
+    ckn = 0;
+    pid = ckspawn(cksink, CKPRIO - 1, (void *)(intptr_t)n);
+    for (int i = 0; i < n; i++)
+        msgs[i] = -i;
+    CK(sendn(pid, msgs, n) == n);
+    CK(receive(&m) == 0 && ckn == n);
+    for (int i = 0; i < n; i++)
+        CK(ckbuf[i] == -i);
+
+    /* sendrecv returns the reply apart from its status */
+    pid = ckspawn(ckecho, CKPRIO - 1, NULL);
+    CK(sendrecv(pid, -1, &m) == 0 && m == -1);
+    CK(sendrecv(pid, 7, &m) == 0 && m == 7);
+
+    /* A receiver exits while we are parked on it and its PID goes to a
+     * new process before we run: the rest of the batch is not sent */
+    pid = ckspawn(ckreuse, CKPRIO + 2, NULL);
+    ckvpid = ckspawn(ckvictim, CKPRIO + 1, (void *)(intptr_t)pid);
+    CK(sendn(ckvpid, msgs, 2 * MBOXDEPTH) == MBOXDEPTH);
+    CK(proctab(ckvpid)->state != PR_FREE && proctab(ckvpid)->mcount == 0);
+    ckpass();
+}
+
+static struct sem cksem;
+static struct mutex ckmtx, ckmtx2;
+static struct cond ckcond;
+static int ckorder[8];          /* Helper indices, in the order served */
+static int nckorder;
+
+/* Take cksem, then note our turn */
+static void cksemw(void *arg)
+{
+    CK(sem_wait(&cksem) == 0);
+    ckorder[nckorder++] = (int)(intptr_t)arg;
+}
+
+/* Take ckmtx, note our turn while we own it, and let go */
+static void ckmtxw(void *arg)
+{
+    CK(mutex_lock(&ckmtx) == 0 && ckmtx.mowner == getpid());
+    ckorder[nckorder++] = (int)(intptr_t)arg;
+    CK(mutex_unlock(&ckmtx) == 0);
+}
+
+/* Wait on ckcond under ckmtx; woken, we own ckmtx again */
+static void ckcondw(void *arg)
+{
+    CK(mutex_lock(&ckmtx) == 0);
+    CK(cond_wait(&ckcond, &ckmtx) == 0 && ckmtx.mowner == getpid());
+    ckorder[nckorder++] = (int)(intptr_t)arg;
+    CK(mutex_unlock(&ckmtx) == 0);
+}
+
+/* Start n helpers above the check and let them run until they block,
+ * in the order they were created */
+static void ckstart(void (*entry)(void *), int n, int *pids)
+{
+    nckorder = 0;
+    for (int i = 0; i < n; i++)
+        pids[i] = ckspawn(entry, CKPRIO + 1, (void *)(intptr_t)i);
+    sleep_ms(1);
+    CK(nckorder == 0);
+}
+
+/* Let the woken helpers run; the first n must have been served in
+ * order */
+static void ckserved(int n)
+{
+    sleep_ms(1);
+    CK(nckorder == n);
+    for (int i = 0; i < n; i++)
+        CK(ckorder[i] == i);
+}
+
+/* Wait queues through semaphores, mutexes and condition variables:
+ * FIFO service, ownership handed over before the new owner runs, and
+ * signalled waiters moved onto the mutex instead of woken */
+static void cksync(void *arg)
+{
+    int pids[3];
+
+    (void)arg;
+    ckpid = getpid();
+
+    /* A signal hands its unit straight to the oldest waiter */
+    sem_init(&cksem, 0);
+    CK(sem_trywait(&cksem) == -1);
+    ckstart(cksemw, 3, pids);
+    for (int i = 0; i < 3; i++) {
+        CK(sem_signal(&cksem) == 0);
+        CK(cksem.scount == 0 && proctab(pids[i])->state == PR_READY);
+    }
+    CK(sem_signal(&cksem) == 0 && cksem.scount == 1);
+    ckserved(3);
+    CK(sem_trywait(&cksem) == 0 && cksem.scount == 0);
+
+    /* Unlock makes the oldest waiter the owner before it runs, so the
+     * unlocker cannot take the mutex back */
+    mutex_init(&ckmtx);
+    CK(mutex_lock(&ckmtx) == 0 && mutex_lock(&ckmtx) == -1);
+    ckstart(ckmtxw, 3, pids);
+    CK(mutex_unlock(&ckmtx) == 0);
+    CK(ckmtx.mowner == pids[0] && proctab(pids[0])->state == PR_READY);
+    CK(proctab(pids[1])->state == PR_WAIT && proctab(pids[2])->state == PR_WAIT);
+    CK(mutex_trylock(&ckmtx) == -1 && mutex_unlock(&ckmtx) == -1);
+    ckserved(3);
+    CK(ckmtx.mowner == -1);
+
+    /* cond_wait needs the mutex held, and the one the waiters use */
+    cond_init(&ckcond);
+    CK(cond_wait(&ckcond, &ckmtx) == -1);
+    ckstart(ckcondw, 3, pids);
+    mutex_init(&ckmtx2);
+    CK(mutex_lock(&ckmtx2) == 0);
+    CK(cond_wait(&ckcond, &ckmtx2) == -1 && ckmtx2.mowner == ckpid);
+    CK(mutex_unlock(&ckmtx2) == 0);
+
+    /* Broadcast under the mutex wakes nobody: every waiter moves to the
+     * mutex's queue, and each unlock then readies exactly one */
+    CK(mutex_lock(&ckmtx) == 0);
+    CK(cond_broadcast(&ckcond) == 0 && wq_empty(&ckcond.cwait));
+    for (int i = 0; i < 3; i++)
+        CK(proctab(pids[i])->state == PR_WAIT);
+    CK(mutex_unlock(&ckmtx) == 0 && ckmtx.mowner == pids[0]);
+    CK(proctab(pids[0])->state == PR_READY);
+    CK(proctab(pids[1])->state == PR_WAIT && proctab(pids[2])->state == PR_WAIT);
+    ckserved(3);
+
+    /* Signal: onto the mutex's queue while it is held, straight to the
+     * mutex when it is free */
+    ckstart(ckcondw, 2, pids);
+    CK(mutex_lock(&ckmtx) == 0 && cond_signal(&ckcond) == 0);
+    CK(proctab(pids[0])->state == PR_WAIT
+       && ckmtx.mwait.wqhead == proctab(pids[0]));
+    CK(mutex_unlock(&ckmtx) == 0 && ckmtx.mowner == pids[0]);
+    ckserved(1);
+    CK(cond_signal(&ckcond) == 0 && ckmtx.mowner == pids[1]);
+    CK(proctab(pids[1])->state == PR_READY);
+    ckserved(2);
+    CK(ckmtx.mowner == -1 && wq_empty(&ckmtx.mwait));
+    ckpass();
+}
+
+struct check {
+    const char *name;
+    void (*entry)(void *);
+};
+
+static const struct check checks[] = {
+    { "mbox", ckmbox },
+    { "sync", cksync },
+};
+#define NCHECK ((int)(sizeof(checks) / sizeof(checks[0])))
+
+/* -----------------------------
+ * Built-in workloads
+ * ----------------------------- */
+
+struct workload {
+    const char *name;
+    const char *script;
+};
+
+static const struct workload builtin[] = {
+    { "cpu",
+      "# Compute-bound processes at one priority: pure time slicing\n"
+      "cpu 2000 1 500\n" },
+    { "ipc",
+      "# Client/server pairs: handoff and mailbox paths\n"
+      "ipc 1000 1 20 20\n" },
+    { "sr",
+      "# The ipc pairs with send() then receive() in place of sendrecv()\n"
+      "sr 1000 1 20 20\n" },
+    { "bursty",
+      "# Mostly sleeping processes over a few compute hogs\n"
+      "burst 2000 2 200 50\n"
+      "cpu 50 1 1000\n" },
+    { "mixed",
+      "# Every kind at several priorities: aging and starvation\n"
+      "cpu 500 0 1000\n"
+      "cpu 500 1 1000\n"
+      "yield 500 1 100\n"
+      "burst 500 3 100 20\n"
+      "ipc 250 2 50 50\n"
+      "cpu 20 5 1000\n" },
+    { "rt",
+      "# EDF control loops over a best-effort load that has aged as high\n"
+      "# as aging goes; the fifth loop would overcommit the CPU\n"
+      "rt 5 10 2 1500\n"
+      "cpu 500 6 1000\n"
+      "burst 500 4 100 5\n" },
+};
+#define NBUILTIN ((int)(sizeof(builtin) / sizeof(builtin[0])))
+
+/* Add the groups a script describes */
+static int parse(const char *name, const char *text)
+{
+    char line[256], kind[16];
+    const char *p = text;
+    int lineno = 0;
+
+    while (*p) {
+        size_t len = strcspn(p, "\n");
+        struct group g;
+        unsigned long work, extra = 0;
+        int k, nf;
+
+        if (len >= sizeof(line))
+            len = sizeof(line) - 1;
+        memcpy(line, p, len);
+        line[len] = '\0';
+        p += strcspn(p, "\n");
+        if (*p)
+            p++;
+        lineno++;
+
+        line[strcspn(line, "#")] = '\0';
+        nf = sscanf(line, "%15s %d %d %lu %lu", kind, &g.n, &g.prio,
+                    &work, &extra);
+        if (nf <= 0)
+            continue;
+        for (k = 0; k < NKIND && strcmp(kind, kname[k]) != 0; k++)
+            ;
+        if (k == K_RT && nf == 5) {
+            /* rt <n> <period_ms> <budget_ms> <work_us> */
+            g.period = g.prio;
+            g.budget = work;
+            g.prio = MAX_PRIO - 1;
+            work = extra;
+        }
+        if (k == NKIND || nf < 4
+                || ((k == K_BURST || k == K_IPC || k == K_SR || k == K_RT)
+                    && nf < 5)
+                || g.n <= 0 || g.prio < 0 || g.prio >= MAX_PRIO
+                || ngroup == MAXGROUP) {
+            fprintf(stderr, "%s:%d: bad script line\n", name, lineno);
+            return -1;
+        }
+        g.kind = k;
+        g.work = work * USCYC;
+        g.extra = extra;
+        g.nreject = 0;
+        g.nmiss = 0;
+        groups[ngroup++] = g;
+    }
+    return 0;
+}
+
+static char *load(const char *path)
+{
+    FILE *f = fopen(path, "r");
+    char *buf;
+    long len;
+
+    if (f == NULL || fseek(f, 0, SEEK_END) != 0 || (len = ftell(f)) < 0) {
+        perror(path);
+        return NULL;
+    }
+    rewind(f);
+    buf = malloc(len + 1);
+    if (buf == NULL || fread(buf, 1, len, f) != (size_t)len) {
+        perror(path);
+        return NULL;
+    }
+    buf[len] = '\0';
+    fclose(f);
+    return buf;
+}
+
+/* -----------------------------
+ * Report
+ * ----------------------------- */
+
+static const char *runname;
+static struct timespec wall0;
+
+static double ms(uint64_t cycles)
+{
+    return (double)cycles * 1000.0 / VHZ;
+}
+
+static void report(void)
+{
+    struct timespec wall1;
+    struct pstat ps;
+    double secs = (double)vnow / VHZ, hostsecs;
+    uint64_t busy = 0, nvol = 0, ninvol = 0;
+    int nproc = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &wall1);
+    hostsecs = (wall1.tv_sec - wall0.tv_sec)
+               + (wall1.tv_nsec - wall0.tv_nsec) / 1e9;
+
+    for (int pid = 0; pid < npid; pid++) {
+        if (pstatget(pid, &ps) != 0 || ps.state == PR_FREE)
+            continue;
+        nproc++;
+        if (pid != NULLPROC)
+            busy += ps.c.cycles;
+        nvol += ps.c.nvol;
+        ninvol += ps.c.ninvol;
+    }
+
+    printf("%s: %d processes, %.1f virtual s in %.2f host s\n",
+           runname, nproc, secs, hostsecs);
+    printf("  switches %u (%.0f/s virtual, %.0f/s host), voluntary %llu, "
+           "involuntary %llu, busy %.1f%%\n",
+           cpus[0].nswitch, cpus[0].nswitch / secs,
+           cpus[0].nswitch / hostsecs, (unsigned long long)nvol,
+           (unsigned long long)ninvol, busy * 100.0 / (double)vnow);
+    printf("  %-5s %5s %4s %11s %6s %6s %9s %9s %7s %6s %7s %6s\n",
+           "group", "n", "prio", "ops/s", "cpu%", "jain", "ready_ms",
+           "maxwt_ms", "starved", "never", "promos", "aged");
+
+    for (int gi = 0; gi < ngroup; gi++) {
+        struct group *g = &groups[gi];
+        uint64_t ops = 0, cyc = 0, ready = 0, maxwait = 0, promos = 0;
+        double sum = 0, sumsq = 0;
+        int n = 0, starved = 0, never = 0, aged = 0;
+
+        for (int pid = 0; pid < npid; pid++) {
+            struct sproc *s = sprocs[pid];
+            uint64_t wait;
+
+            if (s == NULL || s->group != gi || pstatget(pid, &ps) != 0)
+                continue;
+            n++;
+            ops += s->ops;
+            cyc += ps.c.cycles;
+            ready += ps.c.readycyc;
+            sum += ps.c.cycles;
+            sumsq += (double)ps.c.cycles * ps.c.cycles;
+
+            /* The wait it is in now counts too */
+            wait = ps.c.readycyc - s->lastready;
+            if (ps.state == PR_READY && wait > starvecyc)
+                s->nstarve++;
+            if (ps.state == PR_READY && wait > s->maxwait)
+                s->maxwait = wait;
+            if (s->maxwait > maxwait)
+                maxwait = s->maxwait;
+            if (s->nstarve > 0)
+                starved++;
+            if (ps.c.cycles == 0)
+                never++;
+            promos += s->promos;
+            if (proctab(pid)->priority > g->prio)
+                aged++;
+        }
+        printf("  %-5s %5d %4d %11.0f %6.1f %6.3f %9.2f %9.1f %7d %6d "
+               "%7llu %6d\n",
+               kname[g->kind], n, g->prio, ops / secs,
+               cyc * 100.0 / (double)vnow,
+               sumsq > 0 ? sum * sum / (n * sumsq) : 0.0,
+               ms(ready) / (n ? n : 1), ms(maxwait), starved, never,
+               (unsigned long long)promos, aged);
+        if (g->kind == K_RT)
+            printf("        EDF %u/%u ms: %d of %d admitted, %u deadline "
+                   "misses\n", g->budget, g->period, g->n - g->nreject,
+                   g->n, g->nmiss);
+    }
+    fflush(stdout);
+}
+
+/* -----------------------------
+ * Driver
+ * ----------------------------- */
+
+/* Each run starts from a fresh kernel in a child process, since the
+ * simulation ends with exit() from inside it. Returns 0 in the child
+ * and 1 in the parent, once the child has exited 0; exits if not. */
+static int simfork(void)
+{
+    pid_t child;
+    int status;
+
+    fflush(stdout);
+    child = fork();
+    if (child == 0)
+        return 0;
+    if (child < 0 || waitpid(child, &status, 0) < 0) {
+        perror("fork");
+        exit(1);
+    }
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        exit(1);
+    return 1;
+}
+
+/* Bring up the kernel on a fresh arena, to run until duration */
+static void simboot(double duration)
+{
+    static void *arena;
+    struct memrange range;
+
+    arena = malloc(ARENA);
+    if (arena == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    range.mrstart = (uintptr_t)arena;
+    range.mrend = (uintptr_t)arena + ARENA;
+    meminit(&range, 1);
+
+    cpus[0].self = &cpus[0];
+    cpus[0].runpid = NULLPROC;
+    cpus[0].idlepid = NULLPROC;
+    process_init();
+    scheduler_init();
+    twinit();
+    vend = (uint64_t)(duration * VHZ);
+}
+
+/* The null process: nothing to run, so time passes idle */
+static void simidle(void)
+{
+    for (;;)
+        simrun(nexttick - vnow);
+}
+
+static void run(const char *name, const char *script, double duration)
+{
+    ngroup = 0;
+    if (parse(name, script) != 0)
+        exit(1);
+    if (simfork())
+        return;
+
+    simboot(duration);
+    runname = name;
+    for (int gi = 0; gi < ngroup; gi++)
+        startgroup(gi);
+    clock_gettime(CLOCK_MONOTONIC, &wall0);
+    simidle();
+}
+
+static void check(const struct check *ck, double duration)
+{
+    if (simfork())
+        return;
+
+    simboot(duration);
+    checking = ck->name;
+    if (process_create_ex(ck->entry, ck->name, 0, CKPRIO, NULL) < 0)
+        ckfail("process_create_ex");
+    simidle();
+}
+
+int main(int argc, char **argv)
+{
+    double duration = 10;
+    const char *gen = NULL;
+    int opt, kflag = 0;
+
+    while ((opt = getopt(argc, argv, "d:c:t:g:k")) != -1) {
+        switch (opt) {
+        case 'd':
+            duration = strtod(optarg, NULL);
+            break;
+        case 'c':
+            swcost = strtoull(optarg, NULL, 0);
+            break;
+        case 't':
+            starvecyc = strtoull(optarg, NULL, 0) * (VHZ / 1000);
+            break;
+        case 'g':
+            gen = optarg;
+            break;
+        case 'k':
+            kflag = 1;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-d seconds] [-c switch_cycles] "
+                    "[-t starve_ms] [-g workload] [script ...]\n"
+                    "       %s -k\n", argv[0], argv[0]);
+            return 2;
+        }
+    }
+
+    if (gen != NULL) {
+        for (int w = 0; w < NBUILTIN; w++) {
+            if (strcmp(gen, builtin[w].name) == 0) {
+                fputs(builtin[w].script, stdout);
+                return 0;
+            }
+        }
+        fprintf(stderr, "unknown workload '%s'\n", gen);
+        return 2;
+    }
+
+    if (kflag) {
+        for (int i = 0; i < NCHECK; i++)
+            check(&checks[i], duration);
+        return 0;
+    }
+
+    if (optind == argc)
+        for (int w = 0; w < NBUILTIN; w++)
+            run(builtin[w].name, builtin[w].script, duration);
+    for (int i = optind; i < argc; i++) {
+        char *script = load(argv[i]);
+
+        if (script == NULL)
+            return 1;
+        run(argv[i], script, duration);
+        free(script);
+    }
+    return 0;
+}
@@ -0,0 +1,252 @@
+/* strbench.c - Host-side microbenchmark for the kacchiOS string routines
+ *
+ * Builds string.c natively (see the bench-string target in the
+ * Makefile, which renames its symbols to kmemcpy, kstrlen, ...) and
+ * measures throughput against plain byte loops, the way string.c was
+ * written before it had word and SSE2 paths. The mem* routines are run
+ * twice, once with memsse2 clear (rep movsl/stosl) and once with it set.
+ *
+ * Usage: strbench [-m total_mb]
+ *
+ *   -m sets how many megabytes each measurement moves (default 256).
+ *
+ * Every routine is first checked against the byte loops over a spread
+ * of sizes and alignments, including overlapping memmove.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "types.h"
+#include "string.h"
+
+#define MAXSIZE  (1u << 20)     /* Largest buffer measured */
+#define NVARIANT 3              /* byte, word, sse2 */
+
+enum { OP_MEMCPY, OP_MEMSET, OP_STRLEN, OP_STRCMP, NOP };
+
+static uint8_t *bufa, *bufb;
+static volatile size_t sink;    /* Keeps results from being discarded */
+
+/* Reference byte loops; kept out of line so each call is a real call */
+static __attribute__((noinline)) void bytecopy(uint8_t *d, const uint8_t *s,
+                                               size_t n)
+{
+    while (n--)
+        *d++ = *s++;
+}
+
+static __attribute__((noinline)) void byteset(uint8_t *d, int c, size_t n)
+{
+    while (n--)
+        *d++ = (uint8_t)c;
+}
+
+static __attribute__((noinline)) size_t bytelen(const char *s)
+{
+    size_t len = 0;
+
+    while (s[len])
+        len++;
+    return len;
+}
+
+static __attribute__((noinline)) int bytecmp(const char *a, const char *b)
+{
+    while (*a && *a == *b) {
+        a++;
+        b++;
+    }
+    return *(unsigned char *)a - *(unsigned char *)b;
+}
+
+static int sign(int v)
+{
+    return (v > 0) - (v < 0);
+}
+
+static uint64_t nsnow(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static void fail(const char *what, size_t n, size_t off)
+{
+    fprintf(stderr, "strbench: %s wrong at size %zu offset %zu\n",
+            what, n, off);
+    exit(1);
+}
+
+/* Compare every routine with the byte loops */
+static void check(void)
+{
+    static uint8_t ref[4096 + 64];
+    size_t n, off, i;
+
+    for (memsse2 = 0; memsse2 <= 1; memsse2++) {
+        for (n = 0; n <= 1100; n += (n < 80 ? 1 : 37)) {
+            for (off = 0; off < 20; off++) {
+                for (i = 0; i < n + 64; i++)
+                    bufa[i] = (uint8_t)(i * 7 + n);
+
+                kmemset(bufb + off, 0, n + 32);
+                kmemcpy(bufb + off, bufa + 3, n);
+                if (kmemcmp(bufb + off, bufa + 3, n) != 0)
+                    fail("memcpy", n, off);
+                if (bufb[off + n] != 0)
+                    fail("memcpy overrun", n, off);
+
+                kmemset(bufb + off, 0xA5, n);
+                for (i = 0; i < n; i++)
+                    if (bufb[off + i] != 0xA5)
+                        fail("memset", n, off);
+                if (bufb[off + n] != 0)
+                    fail("memset overrun", n, off);
+
+                /* Overlapping moves in both directions */
+                bytecopy(ref, bufa, n + 40);
+                bytecopy(bufb, bufa, n + 40);
+                kmemmove(bufb + off, bufb + 20, n);
+                for (i = n; i-- > 0; )
+                    ref[off + i] = bufa[20 + i];
+                if (kmemcmp(bufb, ref, n + 40) != 0)
+                    fail("memmove", n, off);
+                bytecopy(bufb, bufa, n + 40);
+                kmemmove(bufb + 20, bufb + off, n);
+                bytecopy(ref, bufa, n + 40);
+                for (i = n; i-- > 0; )
+                    ref[20 + i] = bufa[off + i];
+                if (kmemcmp(bufb, ref, n + 40) != 0)
+                    fail("memmove", n, off);
+
+                /* strings of length n at offset off, differing at the end */
+                bytecopy(bufb + off, bufa + off, n + 1);
+                for (i = 0; i < n; i++) {
+                    bufa[off + i] = (uint8_t)('a' + (i % 26));
+                    bufb[off + 2 + i] = bufa[off + i];
+                }
+                bufa[off + n] = bufb[off + 2 + n] = 0;
+                if (kstrlen((char *)bufa + off) != n)
+                    fail("strlen", n, off);
+                if (kstrcmp((char *)bufa + off, (char *)bufb + off + 2) != 0)
+                    fail("strcmp", n, off);
+                if (n > 0) {
+                    bufb[off + 2 + n - 1] ^= 1;
+                    if (sign(kstrcmp((char *)bufa + off,
+                                     (char *)bufb + off + 2)) !=
+                        sign(bytecmp((char *)bufa + off,
+                                     (char *)bufb + off + 2)))
+                        fail("strcmp order", n, off);
+                    if (sign(kmemcmp(bufa + off, bufb + off + 2, n)) !=
+                        sign(bytecmp((char *)bufa + off,
+                                     (char *)bufb + off + 2)))
+                        fail("memcmp order", n, off);
+                }
+            }
+        }
+    }
+}
+
+/* MB/s for one routine at one size; variant 0 is the byte loop */
+static double measure(int op, int variant, size_t n, size_t total)
+{
+    size_t iters = total / n;
+    uint64_t t0, t1;
+    size_t i;
+
+    if (iters < 16)
+        iters = 16;
+    memsse2 = (variant == 2);
+    t0 = nsnow();
+    for (i = 0; i < iters; i++) {
+        switch (op) {
+        case OP_MEMCPY:
+            if (variant)
+                kmemcpy(bufb, bufa, n);
+            else
+                bytecopy(bufb, bufa, n);
+            break;
+        case OP_MEMSET:
+            if (variant)
+                kmemset(bufb, (int)i, n);
+            else
+                byteset(bufb, (int)i, n);
+            break;
+        case OP_STRLEN:
+            sink += variant ? kstrlen((char *)bufa) : bytelen((char *)bufa);
+            break;
+        case OP_STRCMP:
+            sink += variant ? kstrcmp((char *)bufa, (char *)bufb)
+                            : bytecmp((char *)bufa, (char *)bufb);
+            break;
+        }
+    }
+    t1 = nsnow();
+    return (double)n * iters / ((t1 - t0) / 1e9) / 1e6;
+}
+
+int main(int argc, char **argv)
+{
+    static const char *ops[NOP] = { "memcpy", "memset", "strlen", "strcmp" };
+    static const size_t sizes[] = { 16, 64, 256, 1024, 4096, 65536, MAXSIZE };
+    size_t total = 256u << 20;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "m:")) != -1) {
+        switch (opt) {
+        case 'm':
+            total = strtoul(optarg, NULL, 0) << 20;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-m total_mb]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    bufa = aligned_alloc(64, MAXSIZE + 64);
+    bufb = aligned_alloc(64, MAXSIZE + 64);
+    if (bufa == NULL || bufb == NULL) {
+        fprintf(stderr, "strbench: out of memory\n");
+        return 1;
+    }
+    check();
+
+    printf("%-8s %8s %12s %12s %12s %8s\n",
+           "op", "bytes", "byte MB/s", "word MB/s", "sse2 MB/s", "speedup");
+    for (int o = 0; o < NOP; o++) {
+        int nvar = (o == OP_MEMCPY || o == OP_MEMSET) ? NVARIANT : 2;
+
+        for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+            size_t n = sizes[s];
+            double mbs[NVARIANT] = { 0 };
+            double best = 0;
+
+            /* Equal strings of length n - 1 for strlen/strcmp */
+            if (o == OP_STRLEN || o == OP_STRCMP) {
+                kmemset(bufa, 'k', n - 1);
+                kmemset(bufb, 'k', n - 1);
+                bufa[n - 1] = bufb[n - 1] = 0;
+            } else {
+                kmemset(bufa, 0x5A, n);
+            }
+            for (int v = 0; v < nvar; v++) {
+                mbs[v] = measure(o, v, n, total);
+                if (mbs[v] > best)
+                    best = mbs[v];
+            }
+            printf("%-8s %8zu %12.0f %12.0f ", ops[o], n, mbs[0], mbs[1]);
+            if (nvar == NVARIANT)
+                printf("%12.0f", mbs[2]);
+            else
+                printf("%12s", "-");
+            printf(" %7.1fx\n", best / mbs[0]);
+        }
+    }
+    free(bufa);
+    free(bufb);
+    return 0;
+}
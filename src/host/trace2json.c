@@ -0,0 +1,442 @@
+/* trace2json.c - Turn a kacchiOS trace dump into Chrome trace JSON
+ *
+ * trdump() (the "trace" shell command) writes the scheduler trace ring
+ * to COM1 as a binary frame (see trace.h) in among the console text.
+ * Capture the serial output (make run-trace writes serial.log), then
+ *
+ *   trace2json [-n frame] [serial.log] > trace.json
+ *
+ * and open trace.json in chrome://tracing or ui.perfetto.dev. The last
+ * complete frame is converted unless -n picks another (1 = first).
+ *
+ * Two groups of tracks come out:
+ *   CPUs        one track per CPU: which process it ran, and when,
+ *               plus a counter of the highest priority queued there
+ *   processes   one track per process: running, ready (the slice
+ *               ends when it gets a CPU, so its length is the
+ *               scheduling latency) or blocked, by state; send and
+ *               receive are joined by flow arrows
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "types.h"
+#include "process.h"
+#include "trace.h"
+
+#define NPID    65536       /* trevent.pid is 16 bits */
+
+enum { S_NONE, S_RUN, S_READY, S_BLOCKED };
+
+struct proc {
+    int kind;               /* S_* */
+    int why;                /* PR_* state while S_BLOCKED */
+    int waker;              /* Who made it ready, or -1 */
+    int cpu;                /* CPU while S_RUN */
+    double since;           /* When kind began, in microseconds */
+};
+
+/* A send not yet matched by the receiver's receive */
+struct pending {
+    double ts;
+    int sender;
+    int left;               /* Messages of it still in the mailbox */
+    unsigned id;            /* Flow id */
+};
+
+struct mbox {
+    struct pending *q;
+    int head, n, cap;
+};
+
+static struct proc procs[NPID];
+static struct mbox mboxes[NPID];
+static char *names[NPID];
+static int seen[NPID];
+
+static const char *statename[] = {
+    [PR_FREE] = "exited", [PR_READY] = "ready", [PR_CURR] = "running",
+    [PR_TERM] = "terminated", [PR_SLEEP] = "sleep", [PR_BLOCKED] = "blocked",
+    [PR_RECV] = "receive", [PR_SEND] = "send (mailbox full)",
+    [PR_WAIT] = "wait queue", [PR_RTWAIT] = "next period (EDF)",
+};
+
+static int nout;            /* Events written, for the commas */
+
+static void sep(void)
+{
+    fputs(nout++ ? ",\n" : "\n", stdout);
+}
+
+/* Print s as a JSON string */
+static void jstr(const char *s)
+{
+    putchar('"');
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\')
+            printf("\\%c", *s);
+        else if ((unsigned char)*s < 0x20)
+            printf("\\u%04x", (unsigned char)*s);
+        else
+            putchar(*s);
+    }
+    putchar('"');
+}
+
+static const char *pname(int pid)
+{
+    static char buf[32];
+
+    if (names[pid] != NULL)
+        return names[pid];
+    snprintf(buf, sizeof(buf), "pid %d", pid);
+    return buf;
+}
+
+static const char *why(int state)
+{
+    if (state >= 0 && state < (int)(sizeof(statename) / sizeof(statename[0]))
+            && statename[state] != NULL)
+        return statename[state];
+    return "blocked";
+}
+
+/* A complete slice on track (group, tid) */
+static void slice(int group, int tid, const char *name, double ts,
+                  double end, const char *args)
+{
+    sep();
+    printf("{\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,"
+           "\"name\":", group, tid, ts, end - ts);
+    jstr(name);
+    printf(",\"args\":{%s}}", args);
+}
+
+static void instant(int tid, const char *name, double ts)
+{
+    sep();
+    printf("{\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,"
+           "\"name\":", tid, ts);
+    jstr(name);
+    putchar('}');
+}
+
+/* End whatever slice pid is in at t */
+static void pend(int pid, double t)
+{
+    struct proc *p = &procs[pid];
+    char args[96];
+
+    switch (p->kind) {
+    case S_RUN:
+        snprintf(args, sizeof(args), "\"cpu\":%d", p->cpu);
+        slice(1, pid, "running", p->since, t, args);
+        break;
+    case S_READY:
+        if (p->waker >= 0)
+            snprintf(args, sizeof(args), "\"woken_by\":%d", p->waker);
+        else
+            args[0] = '\0';
+        slice(1, pid, "ready", p->since, t, args);
+        break;
+    case S_BLOCKED:
+        slice(1, pid, why(p->why), p->since, t, "");
+        break;
+    }
+    p->kind = S_NONE;
+}
+
+static void pbegin(int pid, int kind, double t)
+{
+    procs[pid].kind = kind;
+    procs[pid].since = t;
+    procs[pid].waker = -1;
+    seen[pid] = 1;
+}
+
+static void mbpush(int pid, struct pending e)
+{
+    struct mbox *m = &mboxes[pid];
+
+    if (m->n == m->cap) {
+        struct pending *q = malloc((m->cap ? 2 * m->cap : 16) * sizeof(*q));
+
+        if (q == NULL) {
+            perror("malloc");
+            exit(1);
+        }
+        for (int i = 0; i < m->n; i++)
+            q[i] = m->q[(m->head + i) % m->cap];
+        free(m->q);
+        m->q = q;
+        m->head = 0;
+        m->cap = m->cap ? 2 * m->cap : 16;
+    }
+    m->q[(m->head + m->n) % m->cap] = e;
+    m->n++;
+}
+
+static void flow(const char *ph, int tid, double ts, unsigned id)
+{
+    sep();
+    printf("{\"ph\":\"%s\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"id\":%u,"
+           "\"cat\":\"ipc\",\"name\":\"message\"%s}", ph, tid, ts, id,
+           ph[0] == 'f' ? ",\"bp\":\"e\"" : "");
+}
+
+/* Check the frame at buf; returns its length, or 0 if it is not whole */
+static size_t frame(const unsigned char *buf, size_t len)
+{
+    struct trhdr h;
+    size_t off = sizeof(h);
+    uint32_t sum = 0, want;
+    struct trname nm;
+
+    if (len < off)
+        return 0;
+    memcpy(&h, buf, sizeof(h));
+    if (memcmp(h.magic, TRMAGIC, 4) != 0 || h.version != TRVERSION
+            || h.evsize != sizeof(struct trevent))
+        return 0;
+    off += (size_t)h.nevent * sizeof(struct trevent);
+    for (;;) {
+        if (off + sizeof(nm) > len)
+            return 0;
+        memcpy(&nm, buf + off, sizeof(nm));
+        off += sizeof(nm);
+        if (nm.pid == TRNONAME)
+            break;
+    }
+    if (off + 8 > len || memcmp(buf + off + 4, TRENDMAGIC, 4) != 0)
+        return 0;
+    for (size_t i = 4; i < off; i++)
+        sum += buf[i];
+    memcpy(&want, buf + off, 4);
+    if (sum != want) {
+        fprintf(stderr, "trace2json: frame checksum mismatch, skipped\n");
+        return 0;
+    }
+    return off + 8;
+}
+
+static void convert(const unsigned char *buf)
+{
+    struct trhdr hdr, *h = &hdr;
+    const unsigned char *evp = buf + sizeof(hdr);
+    const unsigned char *np;
+    struct trevent e;
+    struct trname nm;
+    uint64_t tsc0 = UINT64_MAX;
+    double khz, t = 0;
+    int cpurun[256], maxcpu = -1;
+    double cpusince[256];
+    unsigned flowid = 0;
+
+    memcpy(&hdr, buf, sizeof(hdr));
+    khz = h->tsckhz ? h->tsckhz : 1000000.0;
+    np = evp + (size_t)h->nevent * sizeof(struct trevent);
+    for (memcpy(&nm, np, sizeof(nm)); nm.pid != TRNONAME;
+         np += sizeof(nm), memcpy(&nm, np, sizeof(nm))) {
+        nm.name[sizeof(nm.name) - 1] = '\0';
+        if (nm.pid < NPID)
+            names[nm.pid] = strdup(nm.name);
+    }
+    for (uint32_t i = 0; i < h->nevent; i++) {
+        memcpy(&e, evp + i * sizeof(e), sizeof(e));
+        if (e.tsc < tsc0)
+            tsc0 = e.tsc;
+    }
+    for (int c = 0; c < 256; c++)
+        cpurun[c] = -1;
+    for (int pid = 0; pid < NPID; pid++)
+        procs[pid].waker = -1;
+
+    printf("{\"displayTimeUnit\":\"ns\",\"otherData\":{\"tsc_khz\":%u,"
+           "\"lost_events\":%u},\"traceEvents\":[", h->tsckhz, h->nlost);
+
+    for (uint32_t i = 0; i < h->nevent; i++) {
+        int next, old, to, n;
+        char name[64];
+
+        memcpy(&e, evp + i * sizeof(e), sizeof(e));
+        t = (double)(e.tsc - tsc0) * 1000.0 / khz;
+        if (e.cpu > maxcpu)
+            maxcpu = e.cpu;
+
+        switch (e.type) {
+        case TR_SCHED: {
+            int top = -1;
+
+            for (int pr = 0; pr < 32; pr++)
+                if (e.arg & (1u << pr))
+                    top = pr;
+            sep();
+            printf("{\"ph\":\"C\",\"pid\":0,\"ts\":%.3f,"
+                   "\"name\":\"cpu %d ready\",\"args\":{\"top prio\":%d}}",
+                   t, e.cpu, top);
+            break;
+        }
+
+        case TR_SWITCH:
+            old = e.pid;
+            next = e.arg & 0xFFFF;
+            if (cpurun[e.cpu] >= 0)
+                slice(0, e.cpu, pname(cpurun[e.cpu]), cpusince[e.cpu], t, "");
+            cpurun[e.cpu] = next;
+            cpusince[e.cpu] = t;
+
+            pend(old, t);
+            if ((e.arg >> 16) == PR_READY)
+                pbegin(old, S_READY, t);    /* Preempted or yielded */
+            else if ((e.arg >> 16) != PR_FREE) {
+                pbegin(old, S_BLOCKED, t);
+                procs[old].why = e.arg >> 16;
+            } else
+                seen[old] = 1;
+
+            pend(next, t);
+            pbegin(next, S_RUN, t);
+            procs[next].cpu = e.cpu;
+            break;
+
+        case TR_WAKEUP:
+            to = e.arg & 0xFFFF;
+            if (procs[to].kind == S_RUN || procs[to].kind == S_READY)
+                break;
+            pend(to, t);
+            pbegin(to, S_READY, t);
+            procs[to].waker = e.pid;
+            break;
+
+        case TR_BLOCK:
+            instant(e.pid, "block", t);
+            break;
+
+        case TR_SEND:
+            to = e.arg & 0xFFFF;
+            snprintf(name, sizeof(name), "send %u to %s", e.arg >> 16,
+                     pname(to));
+            instant(e.pid, name, t);
+            flow("s", e.pid, t, ++flowid);
+            mbpush(to, (struct pending){ t, e.pid, (int)(e.arg >> 16),
+                                         flowid });
+            seen[e.pid] = 1;
+            break;
+
+        case TR_RECV: {
+            struct mbox *m = &mboxes[e.pid];
+
+            snprintf(name, sizeof(name), "receive %u", e.arg);
+            instant(e.pid, name, t);
+            /* Sends from before the trace began have no entry */
+            for (n = e.arg; n > 0 && m->n > 0; ) {
+                struct pending *s = &m->q[m->head];
+                int k = (s->left < n) ? s->left : n;
+
+                s->left -= k;
+                n -= k;
+                if (s->left == 0) {
+                    flow("f", e.pid, t, s->id);
+                    m->head = (m->head + 1) % m->cap;
+                    m->n--;
+                }
+            }
+            break;
+        }
+        }
+    }
+
+    /* Close what is still open at the last event */
+    for (int c = 0; c <= maxcpu; c++)
+        if (cpurun[c] >= 0)
+            slice(0, c, pname(cpurun[c]), cpusince[c], t, "");
+    for (int pid = 0; pid < NPID; pid++)
+        pend(pid, t);
+
+    /* Track names */
+    sep();
+    printf("{\"ph\":\"M\",\"pid\":0,\"name\":\"process_name\","
+           "\"args\":{\"name\":\"CPUs\"}}");
+    sep();
+    printf("{\"ph\":\"M\",\"pid\":1,\"name\":\"process_name\","
+           "\"args\":{\"name\":\"processes\"}}");
+    for (int c = 0; c <= maxcpu; c++) {
+        sep();
+        printf("{\"ph\":\"M\",\"pid\":0,\"tid\":%d,\"name\":\"thread_name\","
+               "\"args\":{\"name\":\"cpu %d\"}}", c, c);
+    }
+    for (int pid = 0; pid < NPID; pid++) {
+        char name[48];
+
+        if (!seen[pid])
+            continue;
+        snprintf(name, sizeof(name), "%s (%d)", pname(pid), pid);
+        sep();
+        printf("{\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"name\":\"thread_name\","
+               "\"args\":{\"name\":", pid);
+        jstr(name);
+        printf("}}");
+    }
+    printf("\n]}\n");
+}
+
+int main(int argc, char **argv)
+{
+    FILE *f = stdin;
+    unsigned char *buf = NULL;
+    size_t len = 0, cap = 0, got, flen;
+    size_t pick = 0, last = (size_t)-1;
+    int want = 0, nframe = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:")) != -1) {
+        switch (opt) {
+        case 'n':
+            want = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n frame] [serial.log]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (optind < argc && (f = fopen(argv[optind], "rb")) == NULL) {
+        perror(argv[optind]);
+        return 1;
+    }
+
+    do {
+        if (len == cap) {
+            cap = cap ? 2 * cap : 1 << 20;
+            buf = realloc(buf, cap);
+            if (buf == NULL) {
+                perror("realloc");
+                return 1;
+            }
+        }
+        got = fread(buf + len, 1, cap - len, f);
+        len += got;
+    } while (got > 0);
+
+    /* Frames sit among console text: find every whole one */
+    for (size_t off = 0; off + 4 <= len; off++) {
+        if (buf[off] != TRMAGIC[0] || (flen = frame(buf + off, len - off)) == 0)
+            continue;
+        nframe++;
+        last = off;
+        if (nframe == want)
+            pick = off;
+        off += flen - 1;
+    }
+    if (nframe == 0) {
+        fprintf(stderr, "trace2json: no complete trace frame found\n");
+        return 1;
+    }
+    if (want > nframe || want < 0) {
+        fprintf(stderr, "trace2json: only %d frame(s)\n", nframe);
+        return 1;
+    }
+    convert(buf + (want ? pick : last));
+    return 0;
+}
@@ -0,0 +1,159 @@
+/* twcheck.c - Host-side regression check for the timing wheel
+ *
+ * Builds twheel.c natively (see the check-twheel target in the
+ * Makefile) against a stubbed ready() and drives it with random
+ * inserts and cancels while clkticks runs across its 2^32 wrap. Sleeps
+ * are drawn from every wheel level and from past the top level's
+ * 2^24-tick reach, so the level-boundary cascades and the top-level
+ * parking are exercised. Every wakeup must land on its exact tick, and
+ * once the last sleep is due nothing may be left on the wheel.
+ *
+ * Usage: twcheck [-n ops] [-s seed]
+ *
+ * Exits 0 if every check held, 1 on the first failure.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "types.h"
+#include "clock.h"
+#include "process.h"
+
+#define NSLEEPER    8192    /* PIDs taking turns on the wheel */
+#define MAXSLEEP    ((1u << (TW_LEVELS * TW_BITS)) + (1u << 22))
+
+/* twheel.c reads these from clock.c and process.c */
+uint32_t clkticks;
+struct pcb *pcbdir[NPCBDIR];
+int npid;
+
+static uint64_t nwoke, nremoved, ninsert;
+static uint32_t nasleep;
+
+static uint32_t seed = 12345;
+
+static uint32_t rnd(void)
+{
+    seed = seed * 1103515245 + 12345;
+    return seed >> 8;
+}
+
+static void fail(const char *what, int pid)
+{
+    struct pcb *p = proctab(pid);
+
+    printf("twcheck: %s: pid %d, state %d, twake %u, clkticks %u\n",
+           what, pid, p->state, p->twake, clkticks);
+    exit(1);
+}
+
+/* twtick readies each sleeper that is due: it must be due now */
+void ready(int pid)
+{
+    struct pcb *p = proctab(pid);
+
+    if (p->state != PR_SLEEP)
+        fail("woke a process that was not asleep", pid);
+    if (p->twake != clkticks)
+        fail("woke on the wrong tick", pid);
+    p->state = PR_READY;
+    nasleep--;
+    nwoke++;
+}
+
+/* A sleep length from every level, and past the top one's reach */
+static uint32_t sleeplen(void)
+{
+    uint32_t r = rnd() % 100;
+
+    if (r < 50)
+        return 1 + rnd() % TW_SIZE;
+    if (r < 75)
+        return 1 + rnd() % (1u << (2 * TW_BITS));
+    if (r < 90)
+        return 1 + rnd() % (1u << (3 * TW_BITS));
+    if (r < 98)
+        return 1 + rnd() % (1u << (4 * TW_BITS));
+    return (1u << (4 * TW_BITS)) + rnd() % (MAXSLEEP - (1u << (4 * TW_BITS)));
+}
+
+int main(int argc, char **argv)
+{
+    uint64_t nops = 20000000;
+    uint64_t ops = 0;
+    uint32_t start, last;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:s:")) != -1) {
+        switch (opt) {
+        case 'n':
+            nops = strtoull(optarg, NULL, 0);
+            break;
+        case 's':
+            seed = strtoul(optarg, NULL, 0);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n ops] [-s seed]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    for (int i = 0; i * PCBCHUNK < NSLEEPER; i++) {
+        pcbdir[i] = calloc(PCBCHUNK, sizeof(struct pcb));
+        if (pcbdir[i] == NULL) {
+            perror("calloc");
+            return 1;
+        }
+        for (int j = 0; j < PCBCHUNK; j++) {
+            pcbdir[i][j].pid = npid + j;
+            pcbdir[i][j].state = PR_READY;
+        }
+        npid += PCBCHUNK;
+    }
+
+    /* Start far enough below the wrap that the longest sleeps cross it */
+    start = clkticks = 0u - MAXSLEEP;
+    twinit();
+
+    /* Each tick: an insert or cancel on a random PID, then the tick */
+    while (ops < nops) {
+        int pid = rnd() % NSLEEPER;
+        struct pcb *p = proctab(pid);
+
+        if (p->state != PR_SLEEP) {
+            p->state = PR_SLEEP;
+            twinsert(pid, clkticks + sleeplen());
+            nasleep++;
+            ninsert++;
+        } else if (rnd() % 4 == 0) {
+            twremove(pid);
+            p->state = PR_READY;
+            nasleep--;
+            nremoved++;
+        }
+        ops++;
+
+        clkticks++;
+        twtick();
+    }
+
+    /* Run until the last sleep is due; everything must have woken */
+    last = clkticks + MAXSLEEP;
+    while (nasleep > 0 && clkticks != last) {
+        clkticks++;
+        twtick();
+    }
+    if (nasleep > 0) {
+        for (int pid = 0; pid < NSLEEPER; pid++)
+            if (proctab(pid)->state == PR_SLEEP)
+                fail("still on the wheel after it was due", pid);
+    }
+
+    printf("twcheck: %llu ops (%llu inserts, %llu cancels), %llu wakeups "
+           "on time, ticks %u..%u\n",
+           (unsigned long long)ops, (unsigned long long)ninsert,
+           (unsigned long long)nremoved, (unsigned long long)nwoke,
+           start, clkticks);
+    return 0;
+}
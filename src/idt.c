@@ -0,0 +1,189 @@
+/* idt.c - Interrupt descriptor table and exception handling */
+#include "types.h"
+#include "x86.h"
+#include "serial.h"
+#include "paging.h"
+#include "process.h"
+#include "intr.h"
+#include "smp.h"
+
+struct gatedesc {
+    uint16_t off_lo;
+    uint16_t sel;
+    uint8_t  zero;
+    uint8_t  type;
+    uint16_t off_hi;
+} __attribute__((packed));
+
+/* One table per CPU: each routes page faults to its own task */
+static struct gatedesc idt[NCPU][256];
+
+extern void (*isr_table[32])(void);
+extern void (*irq_table[NIRQ])(void);
+extern void pftask(void);
+extern void ipitick(void);
+extern void ipispurious(void);
+
+static const char *excname[32] = {
+    "divide error", "debug", "NMI", "breakpoint", "overflow",
+    "bound range", "invalid opcode", "device not available",
+    "double fault", "coprocessor overrun", "invalid TSS",
+    "segment not present", "stack fault", "general protection",
+    "page fault", "reserved", "x87 error", "alignment check",
+    "machine check", "SIMD error", "virtualization", "control protection",
+    "reserved", "reserved", "reserved", "reserved", "reserved",
+    "reserved", "reserved", "reserved", "security", "reserved"
+};
+
+/* Install an interrupt gate on every CPU */
+void set_intr_gate(int vec, void (*handler)(void))
+{
+    for (int cpu = 0; cpu < NCPU; cpu++) {
+        struct gatedesc *g = &idt[cpu][vec];
+
+        g->off_lo = (uint32_t)handler & 0xFFFF;
+        g->sel = SEG_KCODE;
+        g->zero = 0;
+        g->type = 0x8E;     /* Present, DPL 0, 32-bit interrupt gate */
+        g->off_hi = ((uint32_t)handler >> 16) & 0xFFFF;
+    }
+}
+
+/* Install a task gate on one CPU */
+void set_task_gate(int cpu, int vec, uint16_t sel)
+{
+    struct gatedesc *g = &idt[cpu][vec];
+
+    g->off_lo = 0;
+    g->sel = sel;
+    g->zero = 0;
+    g->type = 0x85;         /* Present, DPL 0, task gate */
+    g->off_hi = 0;
+}
+
+/* Install the exception, IRQ and (kernel-smp.elf) IPI vectors and
+ * load IDTR */
+void idt_init(void)
+{
+    for (int v = 0; v < 32; v++)
+        set_intr_gate(v, isr_table[v]);
+    for (int irq = 0; irq < NIRQ; irq++)
+        set_intr_gate(IRQBASE + irq, irq_table[irq]);
+#ifdef KACCHI_SMP
+    set_intr_gate(IPI_TICK, ipitick);
+    set_intr_gate(IPI_SPURIOUS, ipispurious);
+#endif
+
+    idt_initcpu(0);
+}
+
+/*------------------------------------------------------------------------
+* idt_initcpu - Set up a CPU's page-fault task and load its IDT
+*------------------------------------------------------------------------
+*/
+void idt_initcpu(
+    int cpu /* Index in cpus[] */
+)
+{
+    struct tss *pf = &cpus[cpu].pftss;
+    struct {
+        uint16_t limit;
+        uint32_t base;
+    } __attribute__((packed)) idtr;
+
+    /* Page faults run as their own task on their own stack */
+    pf->eip = (uint32_t)pftask;
+    pf->esp = (uint32_t)(cpus[cpu].pfstack + sizeof(cpus[cpu].pfstack));
+    pf->eflags = 0x2;
+    pf->cs = SEG_KCODE;
+    pf->ds = pf->es = pf->gs = pf->ss = SEG_KDATA;
+    pf->fs = SEG_CPU(cpu);
+    set_task_gate(cpu, 14, SEG_PFTSS(cpu));
+
+    idtr.limit = sizeof(idt[cpu]) - 1;
+    idtr.base = (uint32_t)idt[cpu];
+    __asm__ volatile ("lidt %0" : : "m"(idtr));
+}
+
+static void halt(void)
+{
+    for (;;)
+        __asm__ volatile ("cli; hlt");
+}
+
+/* Where a process killed by a fault resumes: on a fresh stack top */
+static void faultexit(void)
+{
+    serial_puts("process killed\n");
+    process_exit();
+}
+
+/*------------------------------------------------------------------------
+* trap - Report an exception and kill the process that raised it
+*------------------------------------------------------------------------
+*/
+void trap(
+    struct trapframe *tf /* Built by isr_common */
+)
+{
+    /* First FPU use since a switch: load the state and retry */
+    if (tf->vector == 7 && fputrap() == 0)
+        return;
+
+    serial_puts("trap: ");
+    serial_puts(excname[tf->vector & 31]);
+    serial_puts(" eip=");
+    serial_puthex32(tf->eip);
+    serial_puts(" err=");
+    serial_puthex32(tf->errcode);
+    serial_puts(" pid=");
+    serial_putdec(currpid);
+    serial_puts("\n");
+
+    if (isidle(currpid))
+        halt();
+    process_exit();
+}
+
+/*------------------------------------------------------------------------
+* pf_handle - Page-fault task body: grow a stack or kill the process
+*------------------------------------------------------------------------
+*/
+void pf_handle(
+    uint32_t err /* Page-fault error code */
+)
+{
+    intmask mask; /* Saved interrupt mask */
+    struct tss *tss = &mycpu()->tss;
+    uint32_t addr = read_cr2();
+    uint32_t top;
+
+    /* The faulting process may not hold the kernel lock */
+    mask = disable();
+    if (vmfault(addr) == 0) {
+        restore(mask);
+        return;
+    }
+
+    serial_puts("page fault: addr=");
+    serial_puthex32(addr);
+    serial_puts(" eip=");
+    serial_puthex32(tss->eip);
+    serial_puts(" err=");
+    serial_puthex32(err);
+    if (addr >= STKVBASE && addr < STKVEND
+            && (addr - STKVBASE) % POOLSTKSIZE < PAGE_SIZE)
+        serial_puts(" (stack overflow)");
+    serial_puts(" pid=");
+    serial_putdec(currpid);
+    serial_puts("\n");
+
+    /* The faulting stack may be unusable: resume the task in
+     * faultexit on the top of its own stack */
+    top = (uint32_t)proctab(currpid)->stack_base;
+    if (isidle(currpid) || top == 0)
+        halt();
+    tss->esp = (top & ~0xF) - 16;
+    tss->eip = (uint32_t)faultexit;
+    restore(mask);
+}
@@ -0,0 +1,73 @@
+/* intr.h - Interrupt masking, 8259 PIC and IRQ dispatch */
+#ifndef INTR_H
+#define INTR_H
+
+#include "types.h"
+
+/* Saved interrupt state returned by disable() */
+typedef uint32_t intmask;
+
+#ifdef KACCHI_HOSTED
+/* Host-side tools run kernel code single-threaded in user mode */
+static inline intmask disable(void) { return 0; }
+static inline void restore(intmask mask) { (void)mask; }
+static inline void enable(void) { }
+#else
+#include "x86.h"
+
+#ifdef KACCHI_SMP
+/* With several CPUs, masking interrupts is not enough to own the
+ * kernel: the outermost disable() on a CPU also takes the kernel
+ * lock, and the matching restore() drops it (smp.c). A CPU holding
+ * the lock always has interrupts off. */
+void klock(void);
+void kunlock(void);
+#else
+/* kernel.elf runs on the boot CPU alone: masking interrupts is enough */
+static inline void klock(void) { }
+static inline void kunlock(void) { }
+#endif
+
+/* Disable interrupts and take the kernel lock, returning the
+ * previous EFLAGS */
+static inline intmask disable(void) {
+    intmask mask;
+    __asm__ volatile ("pushfl; popl %0; cli" : "=r"(mask) : : "memory");
+    klock();
+    return mask;
+}
+
+/* Drop the kernel lock, then re-enable interrupts if they were
+ * enabled when mask was taken */
+static inline void restore(intmask mask) {
+    kunlock();
+    if (mask & EFLAGS_IF)
+        __asm__ volatile ("sti" : : : "memory");
+}
+
+static inline void enable(void) {
+    __asm__ volatile ("sti" : : : "memory");
+}
+#endif
+
+/* -----------------------------
+ * Hardware interrupts
+ * -----------------------------
+ * The two 8259s are remapped so IRQ 0-15 arrive on vectors
+ * IRQBASE..IRQBASE+15, clear of the CPU exceptions. All lines start
+ * masked; set_irq_handler unmasks one. The dispatcher sends EOI before
+ * calling the handler, so a handler may switch processes.
+ */
+#define IRQBASE     32
+#define NIRQ        16
+
+#define IRQ_TIMER   0
+#define IRQ_CASCADE 2
+#define IRQ_COM1    4
+
+void pic_init(void);
+void irq_mask(int irq);
+void irq_unmask(int irq);
+void set_irq_handler(int irq, void (*handler)(void));
+
+#endif
@@ -0,0 +1,112 @@
+/* irq.c - 8259 PIC setup and hardware interrupt dispatch */
+#include "types.h"
+#include "io.h"
+#include "x86.h"
+#include "intr.h"
+#include "smp.h"
+#include "clock.h"
+
+#define PIC1_CMD    0x20
+#define PIC1_DATA   0x21
+#define PIC2_CMD    0xA0
+#define PIC2_DATA   0xA1
+
+#define PIC_EOI     0x20
+#define PIC_READISR 0x0B    /* OCW3: next read of the command port is ISR */
+
+static void (*irqhandler[NIRQ])(void);
+
+/*------------------------------------------------------------------------
+* pic_init - Remap both PICs to IRQBASE and mask every line but the
+*            cascade
+*------------------------------------------------------------------------
+*/
+void pic_init(void)
+{
+    outb(PIC1_CMD, 0x11);           /* ICW1: edge, cascade, ICW4 */
+    outb(PIC2_CMD, 0x11);
+    outb(PIC1_DATA, IRQBASE);       /* ICW2: vector offsets */
+    outb(PIC2_DATA, IRQBASE + 8);
+    outb(PIC1_DATA, 1 << IRQ_CASCADE); /* ICW3: slave on IRQ 2 */
+    outb(PIC2_DATA, IRQ_CASCADE);
+    outb(PIC1_DATA, 0x01);          /* ICW4: 8086 mode */
+    outb(PIC2_DATA, 0x01);
+
+    outb(PIC1_DATA, (uint8_t)~(1 << IRQ_CASCADE));
+    outb(PIC2_DATA, 0xFF);
+}
+
+void irq_mask(int irq)
+{
+    uint16_t port = (irq < 8) ? PIC1_DATA : PIC2_DATA;
+
+    outb(port, inb(port) | (1 << (irq & 7)));
+}
+
+void irq_unmask(int irq)
+{
+    uint16_t port = (irq < 8) ? PIC1_DATA : PIC2_DATA;
+
+    outb(port, inb(port) & ~(1 << (irq & 7)));
+}
+
+/*------------------------------------------------------------------------
+* set_irq_handler - Install the handler for an IRQ line and unmask it
+*------------------------------------------------------------------------
+*/
+void set_irq_handler(
+    int irq,                /* IRQ line, 0..NIRQ-1 */
+    void (*handler)(void)   /* Runs with interrupts disabled */
+)
+{
+    irqhandler[irq] = handler;
+    irq_unmask(irq);
+}
+
+/*------------------------------------------------------------------------
+* irq_dispatch - Acknowledge an IRQ or IPI and run its handler under the
+*                kernel lock. EOI goes out first: the handler may switch
+*                to another process, and the PIC or local APIC must not
+*                wait for this frame to unwind.
+*------------------------------------------------------------------------
+*/
+void irq_dispatch(
+    struct trapframe *tf /* Built by irq_common */
+)
+{
+    intmask mask; /* Saved interrupt mask */
+    int irq = tf->vector - IRQBASE;
+
+#ifdef KACCHI_SMP
+    if (tf->vector == IPI_TICK) {
+        lapic_eoi();
+        mask = disable();
+        clktick();
+        restore(mask);
+        return;
+    }
+#endif
+
+    /* IRQ 7 and 15 fire spuriously when a request vanishes: the
+     * in-service bit is clear and no EOI is owed to that PIC */
+    if (irq == 7 || irq == 15) {
+        uint16_t cmd = (irq == 7) ? PIC1_CMD : PIC2_CMD;
+
+        outb(cmd, PIC_READISR);
+        if ((inb(cmd) & 0x80) == 0) {
+            if (irq == 15)
+                outb(PIC1_CMD, PIC_EOI);
+            return;
+        }
+    }
+
+    if (irq >= 8)
+        outb(PIC2_CMD, PIC_EOI);
+    outb(PIC1_CMD, PIC_EOI);
+
+    if (irqhandler[irq] != NULL) {
+        mask = disable();
+        irqhandler[irq]();
+        restore(mask);
+    }
+}
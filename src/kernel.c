@@ -5,15 +5,25 @@
 #include "memory.h"
 #include "process.h"
 #include "scheduler.h"
+#include "multiboot.h"
+#include "x86.h"
+#include "paging.h"
+#include "intr.h"
+#include "clock.h"
+#include "smp.h"
+#include "trace.h"
 
 #define MAX_INPUT 128
-#define RAM_END 0x8000000
+#define SHELL_PRIO  (MAX_PRIO - 1)      /* Above AGING_MAXPRIO */
+#define RAM_END_FALLBACK 0x1000000  /* Used only without a memory map */
 
-/* Idle loop - the NULL process */
+/* Idle loop - the NULL process. The tick makes it yield whenever
+ * anything is queued; between ticks it halts. */
 void null_idle(void)
 {
     while (1) {
         yield();
+        __asm__ volatile ("hlt");
     }
 }
 
@@ -82,9 +92,10 @@ void sender(void)
 
 void receiver(void)
 {
-    while (1)
+    msg_t m;
+
+    while (receive(&m) == 0)
     {
-        int m = receive();
         serial_puts("Received message\n");
         serial_putc('0' + m);
         serial_puts("\n");
@@ -106,9 +117,11 @@ void ctx_test1(void)
 
     while (1) {
         x++;
+        serial_lock();
         serial_puts("test1: ");
         serial_putc('0' + (x % 10));
         serial_puts("\n");
+        serial_unlock();
         yield();
     }
 }
@@ -119,46 +132,114 @@ void ctx_test2(void)
 
     while (1) {
         y++;
+        serial_lock();
         serial_puts("test2: ");
         serial_putc('0' + (y % 10));
         serial_puts("\n");
+        serial_unlock();
         yield();
     }
 }
 
+/* CPU-bound throughput check: NSPIN workers count as fast as they can
+ * for SPINMS. Compare the total under -smp 1 and -smp 4. */
+#define NSPIN   4
+#define SPINMS  1000
 
-extern char __kernel_end;
+static volatile int spinning;
+static volatile int spindone;
+static uint32_t spintotal;
+
+void spinner(void)
+{
+    intmask mask; /* Saved interrupt mask */
+    uint32_t n = 0;
+
+    while (spinning)
+        n++;
+
+    mask = disable();
+    spintotal += n;
+    spindone++;
+    restore(mask);
+}
+
+/* Runs above the workers so its sleeps end on time */
+void spinctl(void)
+{
+    set_priority(getpid(), MAX_PRIO - 1);
+    spintotal = 0;
+    spindone = 0;
+    spinning = 1;
+    for (int i = 0; i < NSPIN; i++)
+        process_create(spinner, "spin");
+
+    sleep_ms(SPINMS);
+    spinning = 0;
+    while (spindone < NSPIN)
+        sleep_ms(1);
+
+    serial_lock();
+    serial_puts("spin: ");
+    serial_putdec(NSPIN);
+    serial_puts(" workers on ");
+    serial_putdec(ncpu);
+    serial_puts(" CPU(s), ");
+    serial_putdec(spintotal);
+    serial_puts(" iterations in ");
+    serial_putdec(SPINMS);
+    serial_puts(" ms\n");
+    serial_unlock();
+}
+
+/* IPC round trip: pingcli times NPING sendrecv calls to pingsrv */
+#define NPING   1000
+
+void pingsrv(void)
+{
+    /* The first request carries the client's PID; -1 ends the run */
+    msg_t m;
+    int client;
+
+    if (receive(&m) != 0)
+        return;
+    client = m;
+    while (sendrecv(client, m, &m) == 0 && m != -1)
+        ;
+}
+
+void pingcli(void)
+{
+    int srv = process_create(pingsrv, "pingsrv");
+    uint32_t start, cycles;
+    msg_t reply;
+
+    if (srv < 0)
+        return;
+    sendrecv(srv, getpid(), &reply);
+
+    start = (uint32_t)rdtsc();
+    for (int i = 0; i < NPING; i++)
+        sendrecv(srv, i, &reply);
+    cycles = (uint32_t)rdtsc() - start;
+    send(srv, -1);
 
-void kmain(void)
+    serial_puts("ping: ");
+    serial_putdec(cycles / NPING);
+    serial_puts(" cycles per round trip\n");
+}
+
+/*------------------------------------------------------------------------
+* shell - Read commands from COM1 and run them. A process of its own,
+*         at a priority aging never lifts other processes to, so it
+*         answers however busy they are; it sleeps until a key comes.
+*------------------------------------------------------------------------
+*/
+void shell(void)
 {
     char input[MAX_INPUT];
-    int pos = 0;
-    /* Initialize hardware */
-    serial_init();
-    serial_puts("Boot OK!\n");
-    
-    /* Initialize memory and processes */
-    meminit(&__kernel_end, (void *)RAM_END);
-    process_init();
-    
-    /* Create test processes */
-    process_create(empty_process, "empty");
-    process_create(ctx_test1, "test1");
-    process_create(ctx_test2, "test2");
-    
-    /* Initialize scheduler */
-    scheduler_init();
-    serial_puts("Scheduler initialized.\n");
-    
-    /* Print welcome message */
-    serial_puts("\n");
-    serial_puts("========================================\n");
-    serial_puts("    kacchiOS - Minimal Baremetal OS\n");
-    serial_puts("========================================\n");
-    serial_puts("Hello from kacchiOS!\n");
-    serial_puts("Running null process...\n\n");
-    
-    /* Main loop - the "null process" */
+    int pos;
+
     while (1) {
         serial_puts("kacchiOS> ");
         pos = 0;
@@ -166,7 +247,7 @@ void kmain(void)
         /* Read input line */
         while (1) {
             char c = serial_getc();
-            
+
             /* Handle Enter key */
             if (c == '\r' || c == '\n') {
                 input[pos] = '\0';
@@ -186,17 +267,108 @@ void kmain(void)
         }
         
         /* Echo back the input */
-        if (pos > 0) {
+        if (strcmp(input, "mem") == 0) {
+            memdump();
+        }
+        else if (strcmp(input, "cpus") == 0) {
+            smp_report();
+        }
+        else if (strcmp(input, "top") == 0) {
+            pstatreport();
+        }
+        else if (strcmp(input, "trace") == 0) {
+            trdump();
+        }
+        else if (strcmp(input, "stk") == 0) {
+            stkreport();
+        }
+        else if (strcmp(input, "spin") == 0) {
+            process_create(spinctl, "spinctl");
+        }
+        else if (strcmp(input, "ping") == 0) {
+            process_create(pingcli, "pingcli");
+        }
+        else if (pos > 0) {
             serial_puts("You typed: ");
             serial_puts(input);
             serial_puts("\n");
         }
-        /* Run the scheduler from here on out - never return */
-        schedule();
     }
+}
+
+extern char __kernel_end;
+
+#ifdef KACCHI_BENCH
+void bench_main(void);  /* bench.c */
+#endif
+
+void kmain(uint32_t magic, struct multiboot_info *mbi)
+{
+    intmask mask; /* Saved interrupt mask */
+    struct memrange ranges[MAXMEMRANGE];
+    int nranges;
+    /* Initialize hardware */
+    serial_init();
+    serial_puts("Boot OK!\n");
+    gdt_init();
+    idt_init();
+    pic_init();
+    cpu_init();
     
-    /* Should never reach here */
-    for (;;) {
-        __asm__ volatile ("hlt");
+    /* Initialize memory and processes */
+    nranges = mbmemranges(magic, mbi, &__kernel_end, ranges, MAXMEMRANGE);
+    if (nranges == 0) {
+        serial_puts("No memory map, assuming 16 MB\n");
+        ranges[0].mrstart = (uint32_t)&__kernel_end;
+        ranges[0].mrend = RAM_END_FALLBACK;
+        nranges = 1;
     }
+    meminit(ranges, nranges);
+    vminit();
+    process_init();
+    
+    /* Initialize scheduler */
+    scheduler_init();
+    serial_puts("Scheduler initialized.\n");
+
+    /* Start the tick: from here on processes are preempted */
+    clkinit();
+    serial_rxinit();
+    enable();
+
+#ifdef KACCHI_SMP
+    /* Start the other CPUs; they steal from the queues filled below.
+     * Only in kernel-smp.elf, built so that disable() also takes the
+     * kernel lock. */
+    smp_init();
+#endif
+
+#ifdef KACCHI_BENCH
+    /* Benchmark image (make bench): bench_main powers off when done */
+    process_create(bench_main, "bench");
+    null_idle();
+#endif
+
+    /* kmain is the null process from here on: the tick would hand the
+     * CPU to the first process created and never give it back */
+    mask = disable();
+
+    /* Create test processes */
+    process_create(empty_process, "empty");
+    process_create(ctx_test1, "test1");
+    process_create(ctx_test2, "test2");
+    
+    /* Print welcome message */
+    serial_puts("\n");
+    serial_puts("========================================\n");
+    serial_puts("    kacchiOS - Minimal Baremetal OS\n");
+    serial_puts("========================================\n");
+    serial_puts("Hello from kacchiOS!\n");
+    serial_puts("Starting the shell...\n\n");
+
+    process_create_ex((void (*)(void *))shell, "shell", 0, SHELL_PRIO, NULL);
+    restore(mask);
+
+    /* From here on this is the null process */
+    null_idle();
 }
@@ -0,0 +1,280 @@
+/* mailbox.c - mboxinit, mboxfree, send, trysend, sendn, sendrecv,
+ *             receive, receiven */
+#include "types.h"
+#include "string.h"
+#include "memory.h"
+#include "intr.h"
+#include "process.h"
+#include "scheduler.h"
+#include "trace.h"
+
+#define MBOXMASK  (MBOXDEPTH - 1)
+
+/* Append k messages to p's ring in at most two copies */
+static void mbcopyin(struct pcb *p, const msg_t *msgs, int k)
+{
+    int tail = (p->mhead + p->mcount) & MBOXMASK;
+    int first = MBOXDEPTH - tail;
+
+    if (first > k)
+        first = k;
+    memcpy(&p->mbuf[tail], msgs, first * sizeof(msg_t));
+    memcpy(&p->mbuf[0], msgs + first, (k - first) * sizeof(msg_t));
+    p->mcount += k;
+}
+
+/* Remove the k oldest messages from p's ring into msgs */
+static void mbcopyout(struct pcb *p, msg_t *msgs, int k)
+{
+    int first = MBOXDEPTH - p->mhead;
+
+    if (first > k)
+        first = k;
+    memcpy(msgs, &p->mbuf[p->mhead], first * sizeof(msg_t));
+    memcpy(msgs + first, &p->mbuf[0], (k - first) * sizeof(msg_t));
+    p->mhead = (p->mhead + k) & MBOXMASK;
+    p->mcount -= k;
+}
+
+/* Make up to n parked senders ready, oldest first */
+static void sndwake(struct pcb *p, int n)
+{
+    struct pcb *s;
+
+    while (n-- > 0 && (s = p->sndhead) != NULL) {
+        p->sndhead = s->qnext;
+        if (p->sndhead == NULL)
+            p->sndtail = NULL;
+        s->qnext = NULL;
+        ready(s->pid);
+    }
+}
+
+/*------------------------------------------------------------------------
+* mboxinit - Give a new process an empty mailbox
+*------------------------------------------------------------------------
+*/
+int mboxinit(
+    int pid /* Process being created */
+)
+{
+    struct pcb *p = proctab(pid);
+
+    p->mbuf = (msg_t *)getmem(MBOXDEPTH * sizeof(msg_t));
+    if (p->mbuf == NULL)
+        return -1;
+    p->mhead = p->mcount = 0;
+    p->sndhead = p->sndtail = NULL;
+    return 0;
+}
+
+/*------------------------------------------------------------------------
+* mboxfree - Discard a mailbox, waking every sender parked on it
+*------------------------------------------------------------------------
+*/
+void mboxfree(
+    int pid /* Process being torn down */
+)
+{
+    struct pcb *p = proctab(pid);
+
+    sndwake(p, NPROC);
+    if (p->mbuf != NULL)
+        freemem(p->mbuf, MBOXDEPTH * sizeof(msg_t));
+    p->mbuf = NULL;
+    p->mcount = 0;
+}
+
+/*------------------------------------------------------------------------
+* sendn - Send n messages in order, parking while the mailbox is full.
+*         A receiver waiting in receive() gets the CPU straight away
+*         (handoff). Returns the number sent, which is short only if the
+*         receiver exits, or -1 if pid has no mailbox. A receiver that
+*         exits while we are parked is told from a new process given
+*         its PID by the PCB's generation.
+*------------------------------------------------------------------------
+*/
+int sendn(
+    int pid,                /* Receiver */
+    const msg_t *msgs,      /* Messages to send */
+    int n                   /* How many */
+)
+{
+    intmask mask; /* Saved interrupt mask */
+    struct pcb *p;
+    struct pcb *self;
+    uint16_t gen;
+    int sent = 0;
+    int k;
+
+    mask = disable();
+    if (isbadpid(pid) || proctab(pid)->mbuf == NULL || n < 0) {
+        restore(mask);
+        return -1;
+    }
+
+    gen = proctab(pid)->pgen;
+    while (sent < n) {
+        p = proctab(pid);
+        if (p->state == PR_FREE || p->pgen != gen || p->mbuf == NULL)
+            break; /* Receiver exited while we were parked */
+
+        k = MBOXDEPTH - p->mcount;
+        if (k > n - sent)
+            k = n - sent;
+        if (k > 0) {
+            mbcopyin(p, msgs + sent, k);
+            trace(TR_SEND, currpid, pid | (uint32_t)k << 16);
+            proctab(currpid)->pcount.nsent += k;
+            sent += k;
+            if (p->state == PR_RECV)
+                handoff(pid);
+            continue;
+        }
+
+        /* Full. Parking on our own mailbox would never end */
+        if (pid == currpid || isidle(currpid))
+            break;
+        self = proctab(currpid);
+        self->state = PR_SEND;
+        self->qnext = NULL;
+        if (p->sndtail != NULL)
+            p->sndtail->qnext = self;
+        else
+            p->sndhead = self;
+        p->sndtail = self;
+        schedule();
+    }
+
+    restore(mask);
+    return sent;
+}
+
+/*------------------------------------------------------------------------
+* send - Send one message, parking while the mailbox is full
+*------------------------------------------------------------------------
+*/
+int send(int pid, msg_t msg)
+{
+    return sendn(pid, &msg, 1) == 1 ? 0 : -1;
+}
+
+/*------------------------------------------------------------------------
+* sendrecv - Send one message and wait for one back. A server blocked in
+*            receive() or its own sendrecv runs at once, and its reply
+*            hands the CPU straight back, so a round trip between two
+*            sendrecv loops never visits the ready queues. Returns 0
+*            with the reply in *reply, or -1 if either side has no
+*            mailbox.
+*------------------------------------------------------------------------
+*/
+int sendrecv(
+    int pid,        /* Receiver */
+    msg_t msg,      /* Request, or reply and wait for the next request */
+    msg_t *reply    /* Receives the answer */
+)
+{
+    intmask mask; /* Saved interrupt mask */
+    struct pcb *self = proctab(currpid);
+    struct pcb *p;
+    int ret;
+
+    mask = disable();
+    if (isbadpid(pid) || pid == currpid || reply == NULL
+            || self->mbuf == NULL || (p = proctab(pid))->mbuf == NULL) {
+        restore(mask);
+        return -1;
+    }
+
+    if (p->state == PR_RECV && p->mcount < MBOXDEPTH && !isidle(currpid)) {
+        /* Rendezvous: wait for the answer from the moment it runs */
+        mbcopyin(p, &msg, 1);
+        trace(TR_SEND, currpid, pid | 1u << 16);
+        self->pcount.nsent++;
+        if (self->mcount == 0)
+            self->state = PR_RECV;
+        handoff(pid);
+    } else if (send(pid, msg) != 0) {
+        restore(mask);
+        return -1;
+    }
+
+    ret = receive(reply);
+    restore(mask);
+    return ret;
+}
+
+/*------------------------------------------------------------------------
+* trysend - Send one message, or return -1 at once if the mailbox is full.
+*           Never gives up the CPU, so interrupt handlers may use it.
+*------------------------------------------------------------------------
+*/
+int trysend(int pid, msg_t msg)
+{
+    intmask mask; /* Saved interrupt mask */
+    struct pcb *p;
+
+    mask = disable();
+    if (isbadpid(pid) || (p = proctab(pid))->mbuf == NULL
+            || p->mcount == MBOXDEPTH) {
+        restore(mask);
+        return -1;
+    }
+
+    mbcopyin(p, &msg, 1);
+    trace(TR_SEND, currpid, pid | 1u << 16);
+    proctab(currpid)->pcount.nsent++;
+    if (p->state == PR_RECV)
+        ready(pid);
+    restore(mask);
+    return 0;
+}
+
+/*------------------------------------------------------------------------
+* receiven - Wait for at least one message, then take up to max of them.
+*            Returns the number received, or -1 without a mailbox.
+*------------------------------------------------------------------------
+*/
+int receiven(
+    msg_t *msgs,    /* Receives the messages, oldest first */
+    int max         /* Room in msgs */
+)
+{
+    intmask mask; /* Saved interrupt mask */
+    struct pcb *p = proctab(currpid);
+    int k;
+
+    mask = disable();
+    if (p->mbuf == NULL || msgs == NULL || max <= 0) {
+        restore(mask);
+        return -1;
+    }
+
+    while (p->mcount == 0) {
+        p->state = PR_RECV;
+        schedule();
+    }
+
+    k = (p->mcount < max) ? p->mcount : max;
+    mbcopyout(p, msgs, k);
+    trace(TR_RECV, currpid, k);
+    p->pcount.nrecv += k;
+
+    /* Each freed slot lets one parked sender make progress */
+    sndwake(p, k);
+
+    restore(mask);
+    return k;
+}
+
+/*------------------------------------------------------------------------
+* receive - Wait for one message and store it in *msg. Returns 0, or -1
+*           without a mailbox; every msg_t value is a message.
+*------------------------------------------------------------------------
+*/
+int receive(
+    msg_t *msg      /* Receives the message */
+)
+{
+    return receiven(msg, 1) == 1 ? 0 : -1;
+}
@@ -0,0 +1,129 @@
+/* membin.c - size-class bins for the free list */
+#include "types.h"
+#include "memory.h"
+
+struct memblk *membins[NBIN];
+uint32_t binmap[NBINMAP];
+
+/*------------------------------------------------------------------------
+* mbbin - Map a (rounded) block size to its size-class bin
+*------------------------------------------------------------------------
+*/
+int mbbin(
+    uint32_t nbytes /* Block size, a multiple of MBSIZE */
+)
+{
+    uint32_t q = nbytes / MBSIZE;
+
+    if (q <= NSMALLBIN)   /* Exact small class */
+    {
+        return (int)q - 1;
+    }
+    /* One bin per power of two above the small classes */
+    return NSMALLBIN + (31 - __builtin_clz(nbytes))
+           - (31 - __builtin_clz(NSMALLBIN * MBSIZE));
+}
+
+/*------------------------------------------------------------------------
+* mbinsert - File a free block in the bin for its current length
+*------------------------------------------------------------------------
+*/
+void mbinsert(
+    struct memblk *blk /* Free block with mlength set */
+)
+{
+    int b = mbbin(blk->mlength);
+
+    blk->bprev = NULL;
+    blk->bnext = membins[b];
+    if (blk->bnext != NULL)
+    {
+        blk->bnext->bprev = blk;
+    }
+    membins[b] = blk;
+    binmap[b >> 5] |= 1u << (b & 31);
+}
+
+/*------------------------------------------------------------------------
+* mbremove - Take a free block out of its bin (before mlength changes)
+*------------------------------------------------------------------------
+*/
+void mbremove(
+    struct memblk *blk /* Block currently filed in a bin */
+)
+{
+    int b = mbbin(blk->mlength);
+
+    if (blk->bprev != NULL)
+    {
+        blk->bprev->bnext = blk->bnext;
+    }
+    else
+    {
+        membins[b] = blk->bnext;
+    }
+    if (blk->bnext != NULL)
+    {
+        blk->bnext->bprev = blk->bprev;
+    }
+    if (membins[b] == NULL)
+    {
+        binmap[b >> 5] &= ~(1u << (b & 31));
+    }
+}
+
+/* Lowest non-empty bin at or above b, or -1 */
+static int mbnext(int b)
+{
+    for (int w = b >> 5; w < NBINMAP; w++)
+    {
+        uint32_t bits = binmap[w];
+
+        if (w == (b >> 5))
+        {
+            bits &= ~0u << (b & 31);
+        }
+        if (bits != 0)
+        {
+            return (w << 5) + __builtin_ctz(bits);
+        }
+    }
+    return -1;
+}
+
+/*------------------------------------------------------------------------
+* mbfind - Find a free block of at least nbytes (left in its bin)
+*------------------------------------------------------------------------
+*/
+struct memblk *mbfind(
+    uint32_t nbytes /* Rounded request size */
+)
+{
+    struct memblk *blk;
+    int b = mbbin(nbytes);
+
+    if (b < NSMALLBIN)   /* Small class: every block in bin fits exactly */
+    {
+        if (membins[b] != NULL)
+        {
+            return membins[b];
+        }
+    }
+    else     /* Large bins span a size range: first fit within it */
+    {
+        for (blk = membins[b]; blk != NULL; blk = blk->bnext)
+        {
+            if (blk->mlength >= nbytes)
+            {
+                return blk;
+            }
+        }
+    }
+    /* Any block in a higher bin is big enough */
+    b = mbnext(b + 1);
+    if (b < 0)
+    {
+        return NULL;
+    }
+    return membins[b];
+}
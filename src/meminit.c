@@ -4,15 +4,22 @@ struct memblk memlist;
 void *minheap;
 void *maxheap;
 
-void meminit(void *heap_start, void *heap_end)
+void meminit(struct memrange *ranges, int nranges)
 {
-    minheap = heap_start;
-    maxheap = heap_end;
+    /* All usable frames go to the buddy allocator; the heap starts
+     * empty and grows from it on demand (see memgrow) */
+    pginit(ranges, nranges);
 
-    memlist.mnext = (struct memblk *)heap_start;
-    memlist.mlength = (uint32_t)((uint8_t *)heap_end -
-                                 (uint8_t *)heap_start);
+    minheap = pgbase;
+    maxheap = (void *)((uintptr_t)pgbase + pgcount * PAGE_SIZE);
 
-    memlist.mnext->mnext = NULL;
-    memlist.mnext->mlength = memlist.mlength;
+    for (int b = 0; b < NBIN; b++)
+        membins[b] = NULL;
+    for (int w = 0; w < NBINMAP; w++)
+        binmap[w] = 0;
+
+    memroot = NULL;
+    memnblk = 0;
+    memlist.mlength = 0;
+    memused = mempeak = 0;
 }
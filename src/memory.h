@@ -5,31 +5,190 @@
 
 #define PAGE_SIZE 4096
 
-/* round and truncate to 8-byte boundary */
-#define roundmb(x) ( (uint32_t)( (x + 7) & ~7 ) )
-#define truncmb(x) ( (uint32_t)( x & ~7 ) )
+/* Allocation granule: every free block must be able to hold a
+ * struct memblk, so sizes are rounded to eight machine words. */
+#define MBSIZE  ((uint32_t)(8 * sizeof(void *)))
+
+/* round and truncate to memblk-granule boundary */
+#define roundmb(x) ( (uint32_t)( ((x) + MBSIZE - 1) & ~(MBSIZE - 1) ) )
+#define truncmb(x) ( (uint32_t)( (x) & ~(MBSIZE - 1) ) )
 
 struct memblk {
-    struct memblk *mnext;
-    uint32_t mlength;
+    uint32_t mlength;       /* size of this free block in bytes */
+    struct memblk *bnext;   /* next block in the same size bin */
+    struct memblk *bprev;   /* previous block in the same size bin */
+    struct memblk *mleft;   /* address tree: lower blocks */
+    struct memblk *mright;  /* address tree: higher blocks */
+    struct memblk *mparent; /* address tree parent */
+    uint32_t mmax;          /* largest mlength in this subtree */
+    uint32_t mred;          /* nonzero if red in the address tree */
 };
 
-/* Free list head */
+/* Free byte count (memlist.mlength) */
 extern struct memblk memlist;
 
+/* -----------------------------
+ * Address-ordered free-block index
+ * -----------------------------
+ * Free blocks form a red-black tree keyed by address, augmented with
+ * the largest block in each subtree. Neighbour lookup for coalescing
+ * and the highest-fit search for getstk are O(log n).
+ */
+extern struct memblk *memroot;
+
+void mtinsert(struct memblk *blk);
+void mtremove(struct memblk *blk);
+void mtreplace(struct memblk *old, struct memblk *nblk);
+void mtresize(struct memblk *blk);
+void mtneighbors(void *addr, struct memblk **prev, struct memblk **next);
+struct memblk *mthighest(uint32_t nbytes);
+
+/* A usable physical memory range [mrstart, mrend) */
+struct memrange {
+    uintptr_t mrstart;
+    uintptr_t mrend;
+};
+
+#define MAXMEMRANGE  16     /* Most ranges meminit accepts */
+
+/* RAM above this is not used: the addresses above it hold stacks */
+#define MAXPHYSADDR  0xE0000000
+
 /* Heap bounds */
 extern void *minheap;
 extern void *maxheap;
 
+/* -----------------------------
+ * Segregated size-class bins
+ * -----------------------------
+ * Bins 0..NSMALLBIN-1 hold blocks of exactly (i+1)*MBSIZE bytes.
+ * Above that, each bin holds one power-of-two size range.
+ * binmap has a bit set for every non-empty bin.
+ */
+#define NSMALLBIN   32
+#define NBIN        64
+#define NBINMAP     (NBIN / 32)
+
+extern struct memblk *membins[NBIN];
+extern uint32_t binmap[NBINMAP];
+
+int  mbbin(uint32_t nbytes);
+void mbinsert(struct memblk *blk);
+void mbremove(struct memblk *blk);
+struct memblk *mbfind(uint32_t nbytes);
+
+/* -----------------------------
+ * Buddy page allocator
+ * -----------------------------
+ * Page frames above the kernel are managed in power-of-two blocks
+ * (orders 0..MAX_ORDER) with a free list and a free bitmap per order,
+ * so split and merge are O(log n). The getmem heap grows by pulling
+ * blocks of at least HEAPGROW_ORDER from here.
+ */
+#define MAX_ORDER       12   /* Largest block: 2^12 pages = 16 MB */
+#define HEAPGROW_ORDER  4    /* Heap grows 64 KB at a time */
+
+extern void *pgbase;        /* Address of page frame 0 */
+extern uint32_t pgcount;    /* Frames covered by the allocator */
+extern uint32_t pgnfree;    /* Frames currently free */
+
+void pginit(struct memrange *ranges, int nranges);
+int pgorder(uint32_t nbytes);
+int pgmaxorder(void);
+void *alloc_pages(int order);
+int free_pages(void *addr, int order);
+int memgrow(uint32_t nbytes);
+
+/* -----------------------------
+ * Region (arena) allocator
+ * -----------------------------
+ * An arena is a list of page-block chunks carved with a bump pointer.
+ * Individual allocations are never freed; arenarelease hands the
+ * whole arena back to the page allocator at once.
+ */
+#define ARENA_ORDER  0       /* Default chunk: one page */
+
+struct archunk {
+    struct archunk *anext;  /* Next (older) chunk in the arena */
+    uint32_t aorder;        /* Page order of this chunk */
+    uint32_t aused;         /* Bytes used, including this header */
+};
+
+void *arenaalloc(struct archunk **arena, uint32_t nbytes);
+void arenarelease(struct archunk **arena);
+
+/* -----------------------------
+ * Stack pool
+ * -----------------------------
+ * Fixed-size virtual stack slots above MAXPHYSADDR (see paging.h).
+ * Freed slots sit on an intrusive free stack linked through their top
+ * word, and never-used slots are handed out in order, so
+ * getpstk/freepstk are O(1) and stack churn never fragments the getmem
+ * heap. Only the pages a process touches are backed by frames.
+ */
+#define NPOOLSTK     256     /* Number of pooled stack slots */
+#define POOLSTKSIZE  0x10000 /* Virtual bytes per slot, guard page included */
+
+/* Stack paint (stkwatch.c): every byte of an untouched stack word */
+#define STKPAINT     0xA5
+#define STKPAINTWORD 0xA5A5A5A5
+
+extern void *minpstk;    /* Lowest address of the stack pool */
+extern void *maxpstk;    /* One past the highest address of the pool */
+
+void pstkinit(void *base, uint32_t nslots);
+void *getpstk(void);
+int freepstk(void *stktop);
+
+/* -----------------------------
+ * Telemetry
+ * -----------------------------
+ * Counters kept by the allocators themselves. bincount is indexed by
+ * getmem/getstk size class, pgordcount by page order. memused counts
+ * bytes handed out by alloc_pages plus heap bytes handed out by
+ * getmem/getstk, minus heap free space.
+ */
+struct memcount {
+    uint32_t nalloc;    /* Successful allocations */
+    uint32_t nfree;     /* Frees */
+    uint32_t nfail;     /* Allocations that returned NULL */
+};
+
+struct memstat {
+    uint32_t ms_total;      /* Bytes under management */
+    uint32_t ms_free;       /* Free bytes (pages + heap) */
+    uint32_t ms_heapfree;   /* Free bytes in the getmem heap */
+    uint32_t ms_largest;    /* Largest single free block */
+    uint32_t ms_nfree;      /* Free blocks (pages + heap) */
+    uint32_t ms_frag;       /* 1000 * (1 - largest / free) */
+    uint32_t ms_used;       /* Bytes in use now */
+    uint32_t ms_peak;       /* Most bytes ever in use */
+};
+
+extern struct memcount bincount[NBIN];
+extern struct memcount pgordcount[MAX_ORDER + 1];
+extern uint32_t memused;    /* Bytes in use */
+extern uint32_t mempeak;    /* High-water mark of memused */
+extern uint32_t memnblk;    /* Free blocks in the heap tree */
+extern uint32_t pgnblk;     /* Free blocks on the page lists */
+extern uint32_t pgtotal;    /* Frames handed to pginit */
+
+#define MEMUSE(n) \
+    do { memused += (n); if (memused > mempeak) mempeak = memused; } while (0)
+#define MEMUNUSE(n)  (memused -= (n))
+
+void memstat(struct memstat *ms);
+void memdump(void);
+
 /* Memory manager API */
-void meminit(void *heap_start, void *heap_end);
+void meminit(struct memrange *ranges, int nranges);
 void *getmem(uint32_t nbytes);
 int freemem(void *blkaddr, uint32_t nbytes);
 void *getstk(uint32_t nbytes);
 
 /* Stack free macro (XINU style) */
 #define freestk(p,len) \
-    freemem((void *)((uint32_t)(p) - roundmb(len) + sizeof(uint32_t)), \
+    freemem((void *)((uintptr_t)(p) - roundmb(len) + sizeof(uint32_t)), \
             roundmb(len))
 
 #endif
@@ -0,0 +1,112 @@
+/* memstat.c - memstat, memdump */
+#include "types.h"
+#include "memory.h"
+#include "intr.h"
+#include "serial.h"
+
+struct memcount bincount[NBIN];
+struct memcount pgordcount[MAX_ORDER + 1];
+uint32_t memused;
+uint32_t mempeak;
+
+/*------------------------------------------------------------------------
+* memstat - Snapshot heap and page allocator state
+*------------------------------------------------------------------------
+*/
+void memstat(
+    struct memstat *ms /* Filled in on return */
+)
+{
+    intmask mask; /* Saved interrupt mask */
+    int order;
+    mask = disable();
+    ms->ms_total = pgtotal * PAGE_SIZE;
+    ms->ms_heapfree = memlist.mlength;
+    ms->ms_free = pgnfree * PAGE_SIZE + memlist.mlength;
+    ms->ms_nfree = pgnblk + memnblk;
+    ms->ms_used = memused;
+    ms->ms_peak = mempeak;
+
+    /* Both sides keep their maximum at hand: the tree root's subtree
+     * maximum and the highest non-empty page order */
+    ms->ms_largest = (memroot != NULL) ? memroot->mmax : 0;
+    order = pgmaxorder();
+    if (order >= 0 && ((uint32_t)PAGE_SIZE << order) > ms->ms_largest)
+        ms->ms_largest = (uint32_t)PAGE_SIZE << order;
+
+    /* No 64-bit divide here: scale big values down to KB first */
+    if (ms->ms_free == 0)
+        ms->ms_frag = 0;
+    else if (ms->ms_free < (1u << 22))
+        ms->ms_frag = 1000 - ms->ms_largest * 1000 / ms->ms_free;
+    else
+        ms->ms_frag = 1000 - (ms->ms_largest >> 10) * 1000
+                             / (ms->ms_free >> 10);
+    restore(mask);
+}
+
+static void putcount(const char *label, uint32_t size, struct memcount *c)
+{
+    serial_puts(label);
+    serial_putdec(size);
+    serial_puts(" alloc=");
+    serial_putdec(c->nalloc);
+    serial_puts(" free=");
+    serial_putdec(c->nfree);
+    serial_puts(" fail=");
+    serial_putdec(c->nfail);
+    serial_puts("\n");
+}
+
+/*------------------------------------------------------------------------
+* memdump - Print memstat and the non-zero class counters on COM1
+*------------------------------------------------------------------------
+*/
+void memdump(void)
+{
+    struct memstat ms;
+
+    memstat(&ms);
+    serial_puts("mem total=");
+    serial_putdec(ms.ms_total);
+    serial_puts(" free=");
+    serial_putdec(ms.ms_free);
+    serial_puts(" heapfree=");
+    serial_putdec(ms.ms_heapfree);
+    serial_puts(" used=");
+    serial_putdec(ms.ms_used);
+    serial_puts(" peak=");
+    serial_putdec(ms.ms_peak);
+    serial_puts("\nmem largest=");
+    serial_putdec(ms.ms_largest);
+    serial_puts(" nfree=");
+    serial_putdec(ms.ms_nfree);
+    serial_puts(" frag=");
+    serial_putdec(ms.ms_frag);
+    serial_puts("/1000\n");
+
+    /* Size classes are named by their smallest block */
+    for (int b = 0; b < NBIN; b++)
+    {
+        struct memcount *c = &bincount[b];
+        uint32_t size;
+
+        if (c->nalloc == 0 && c->nfree == 0 && c->nfail == 0)
+            continue;
+        if (b < NSMALLBIN)
+            size = (b + 1) * MBSIZE;
+        else if (b == NSMALLBIN)
+            size = (NSMALLBIN + 1) * MBSIZE;
+        else
+            size = (NSMALLBIN * MBSIZE) << (b - NSMALLBIN);
+        putcount("bin ", size, c);
+    }
+    for (int order = 0; order <= MAX_ORDER; order++)
+    {
+        struct memcount *c = &pgordcount[order];
+
+        if (c->nalloc == 0 && c->nfree == 0 && c->nfail == 0)
+            continue;
+        putcount("pages ", (uint32_t)PAGE_SIZE << order, c);
+    }
+}
@@ -0,0 +1,342 @@
+/* memtree.c - address-ordered red-black index of free blocks */
+#include "types.h"
+#include "memory.h"
+
+struct memblk *memroot;
+uint32_t memnblk;
+
+#define isred(b)  ((b) != NULL && (b)->mred)
+
+/* Recompute the subtree maximum of one node from its children */
+static void mtupdate(struct memblk *blk)
+{
+    uint32_t max = blk->mlength;
+
+    if (blk->mleft != NULL && blk->mleft->mmax > max)
+        max = blk->mleft->mmax;
+    if (blk->mright != NULL && blk->mright->mmax > max)
+        max = blk->mright->mmax;
+    blk->mmax = max;
+}
+
+/* Make v take u's place under u's parent */
+static void mtsetchild(struct memblk *u, struct memblk *v)
+{
+    if (u->mparent == NULL)
+        memroot = v;
+    else if (u == u->mparent->mleft)
+        u->mparent->mleft = v;
+    else
+        u->mparent->mright = v;
+    if (v != NULL)
+        v->mparent = u->mparent;
+}
+
+static void mtrotleft(struct memblk *x)
+{
+    struct memblk *y = x->mright;
+
+    x->mright = y->mleft;
+    if (y->mleft != NULL)
+        y->mleft->mparent = x;
+    mtsetchild(x, y);
+    y->mleft = x;
+    x->mparent = y;
+    mtupdate(x);
+    mtupdate(y);
+}
+
+static void mtrotright(struct memblk *x)
+{
+    struct memblk *y = x->mleft;
+
+    x->mleft = y->mright;
+    if (y->mright != NULL)
+        y->mright->mparent = x;
+    mtsetchild(x, y);
+    y->mright = x;
+    x->mparent = y;
+    mtupdate(x);
+    mtupdate(y);
+}
+
+/*------------------------------------------------------------------------
+* mtresize - Propagate a change in blk->mlength up to the root
+*------------------------------------------------------------------------
+*/
+void mtresize(
+    struct memblk *blk /* Block whose mlength changed */
+)
+{
+    for (; blk != NULL; blk = blk->mparent)
+        mtupdate(blk);
+}
+
+/*------------------------------------------------------------------------
+* mtinsert - Add a free block (mlength set) to the address tree
+*------------------------------------------------------------------------
+*/
+void mtinsert(
+    struct memblk *blk /* Block to index */
+)
+{
+    struct memblk *parent = NULL, **link = &memroot;
+
+    while (*link != NULL)
+    {
+        parent = *link;
+        if (parent->mmax < blk->mlength)
+            parent->mmax = blk->mlength;
+        link = (blk < parent) ? &parent->mleft : &parent->mright;
+    }
+    blk->mparent = parent;
+    blk->mleft = blk->mright = NULL;
+    blk->mmax = blk->mlength;
+    blk->mred = 1;
+    *link = blk;
+    memnblk++;
+
+    /* Rebalance */
+    while (isred(blk->mparent))
+    {
+        struct memblk *p = blk->mparent, *g = p->mparent, *u;
+
+        if (p == g->mleft)
+        {
+            u = g->mright;
+            if (isred(u))
+            {
+                p->mred = u->mred = 0;
+                g->mred = 1;
+                blk = g;
+                continue;
+            }
+            if (blk == p->mright)
+            {
+                mtrotleft(p);
+                blk = p;
+                p = blk->mparent;
+            }
+            p->mred = 0;
+            g->mred = 1;
+            mtrotright(g);
+        }
+        else
+        {
+            u = g->mleft;
+            if (isred(u))
+            {
+                p->mred = u->mred = 0;
+                g->mred = 1;
+                blk = g;
+                continue;
+            }
+            if (blk == p->mleft)
+            {
+                mtrotright(p);
+                blk = p;
+                p = blk->mparent;
+            }
+            p->mred = 0;
+            g->mred = 1;
+            mtrotleft(g);
+        }
+    }
+    memroot->mred = 0;
+}
+
+/*------------------------------------------------------------------------
+* mtremove - Drop a block from the address tree
+*------------------------------------------------------------------------
+*/
+void mtremove(
+    struct memblk *z /* Block currently in the tree */
+)
+{
+    struct memblk *x, *xparent, *w;
+    int wasred = z->mred;
+
+    memnblk--;
+    if (z->mleft == NULL)
+    {
+        x = z->mright;
+        xparent = z->mparent;
+        mtsetchild(z, x);
+    }
+    else if (z->mright == NULL)
+    {
+        x = z->mleft;
+        xparent = z->mparent;
+        mtsetchild(z, x);
+    }
+    else     /* Splice in the successor */
+    {
+        struct memblk *y = z->mright;
+
+        while (y->mleft != NULL)
+            y = y->mleft;
+        wasred = y->mred;
+        x = y->mright;
+        if (y->mparent == z)
+        {
+            xparent = y;
+        }
+        else
+        {
+            xparent = y->mparent;
+            mtsetchild(y, x);
+            y->mright = z->mright;
+            y->mright->mparent = y;
+        }
+        mtsetchild(z, y);
+        y->mleft = z->mleft;
+        y->mleft->mparent = y;
+        y->mred = z->mred;
+    }
+    mtresize(xparent);
+
+    if (wasred)
+        return;
+
+    /* Rebalance */
+    while (x != memroot && !isred(x))
+    {
+        if (x == xparent->mleft)
+        {
+            w = xparent->mright;
+            if (isred(w))
+            {
+                w->mred = 0;
+                xparent->mred = 1;
+                mtrotleft(xparent);
+                w = xparent->mright;
+            }
+            if (!isred(w->mleft) && !isred(w->mright))
+            {
+                w->mred = 1;
+                x = xparent;
+                xparent = x->mparent;
+            }
+            else
+            {
+                if (!isred(w->mright))
+                {
+                    w->mleft->mred = 0;
+                    w->mred = 1;
+                    mtrotright(w);
+                    w = xparent->mright;
+                }
+                w->mred = xparent->mred;
+                xparent->mred = 0;
+                w->mright->mred = 0;
+                mtrotleft(xparent);
+                x = memroot;
+            }
+        }
+        else
+        {
+            w = xparent->mleft;
+            if (isred(w))
+            {
+                w->mred = 0;
+                xparent->mred = 1;
+                mtrotright(xparent);
+                w = xparent->mleft;
+            }
+            if (!isred(w->mleft) && !isred(w->mright))
+            {
+                w->mred = 1;
+                x = xparent;
+                xparent = x->mparent;
+            }
+            else
+            {
+                if (!isred(w->mleft))
+                {
+                    w->mright->mred = 0;
+                    w->mred = 1;
+                    mtrotleft(w);
+                    w = xparent->mleft;
+                }
+                w->mred = xparent->mred;
+                xparent->mred = 0;
+                w->mleft->mred = 0;
+                mtrotright(xparent);
+                x = memroot;
+            }
+        }
+    }
+    if (x != NULL)
+        x->mred = 0;
+}
+
+/*------------------------------------------------------------------------
+* mtreplace - Put nblk in old's place (same tree position, O(1))
+*------------------------------------------------------------------------
+*/
+void mtreplace(
+    struct memblk *old, /* Block leaving the tree */
+    struct memblk *nblk /* Block taking its slot; must sort the same */
+)
+{
+    nblk->mleft = old->mleft;
+    nblk->mright = old->mright;
+    nblk->mred = old->mred;
+    nblk->mmax = old->mmax;
+    mtsetchild(old, nblk);
+    if (nblk->mleft != NULL)
+        nblk->mleft->mparent = nblk;
+    if (nblk->mright != NULL)
+        nblk->mright->mparent = nblk;
+}
+
+/*------------------------------------------------------------------------
+* mtneighbors - Find the free blocks just below and at/above addr
+*------------------------------------------------------------------------
+*/
+void mtneighbors(
+    void *addr, /* Address being freed */
+    struct memblk **prev, /* Highest block below addr, or NULL */
+    struct memblk **next /* Lowest block at or above addr, or NULL */
+)
+{
+    struct memblk *blk = memroot;
+
+    *prev = *next = NULL;
+    while (blk != NULL)
+    {
+        if ((void *)blk < addr)
+        {
+            *prev = blk;
+            blk = blk->mright;
+        }
+        else
+        {
+            *next = blk;
+            blk = blk->mleft;
+        }
+    }
+}
+
+/*------------------------------------------------------------------------
+* mthighest - Highest-addressed free block of at least nbytes
+*------------------------------------------------------------------------
+*/
+struct memblk *mthighest(
+    uint32_t nbytes /* Rounded request size */
+)
+{
+    struct memblk *blk = memroot;
+
+    if (blk == NULL || blk->mmax < nbytes)
+        return NULL;
+    for (;;)
+    {
+        if (blk->mright != NULL && blk->mright->mmax >= nbytes)
+            blk = blk->mright;
+        else if (blk->mlength >= nbytes)
+            return blk;
+        else
+            blk = blk->mleft;
+    }
+}
@@ -0,0 +1,73 @@
+/* multiboot.c - Parse the bootloader's memory map */
+#include "types.h"
+#include "multiboot.h"
+
+/* Clip [start, end) to [floor, MAXPHYSADDR) and append what is left */
+static int addrange(uint64_t start, uint64_t end, uint32_t floor,
+                    struct memrange *ranges, int n, int maxranges)
+{
+    if (end > MAXPHYSADDR)
+        end = MAXPHYSADDR;
+    if (start < floor)
+        start = floor;
+    if (start >= end || n >= maxranges)
+        return n;
+    ranges[n].mrstart = (uint32_t)start;
+    ranges[n].mrend = (uint32_t)end;
+    return n + 1;
+}
+
+/*------------------------------------------------------------------------
+* mbmemranges - Build the usable-RAM list from multiboot information
+*------------------------------------------------------------------------
+*/
+int mbmemranges(
+    uint32_t magic, /* EAX at entry */
+    struct multiboot_info *mbi, /* EBX at entry */
+    void *floor, /* Lowest address to hand out (end of kernel) */
+    struct memrange *ranges, /* Output, ascending */
+    int maxranges /* Capacity of ranges */
+)
+{
+    int n = 0;
+
+    if (magic != MULTIBOOT_BOOTLOADER_MAGIC || mbi == NULL)
+        return 0;
+
+    if (mbi->flags & MBI_FLAG_MMAP)
+    {
+        uint32_t p = mbi->mmap_addr;
+        uint32_t end = mbi->mmap_addr + mbi->mmap_length;
+
+        while (p < end)
+        {
+            struct multiboot_mmap_entry *e = (struct multiboot_mmap_entry *)p;
+
+            if (e->type == MMAP_AVAILABLE)
+                n = addrange(e->addr, e->addr + e->len, (uint32_t)floor,
+                             ranges, n, maxranges);
+            p += e->size + sizeof(e->size);
+        }
+    }
+    else if (mbi->flags & MBI_FLAG_MEM)
+    {
+        /* No map: one range from 1 MB up */
+        n = addrange(0x100000, 0x100000 + (uint64_t)mbi->mem_upper * 1024,
+                     (uint32_t)floor, ranges, n, maxranges);
+    }
+
+    /* Keep ranges ascending (maps are usually sorted already) */
+    for (int i = 1; i < n; i++)
+    {
+        struct memrange r = ranges[i];
+        int j = i - 1;
+
+        while (j >= 0 && ranges[j].mrstart > r.mrstart)
+        {
+            ranges[j + 1] = ranges[j];
+            j--;
+        }
+        ranges[j + 1] = r;
+    }
+    return n;
+}
@@ -0,0 +1,41 @@
+/* multiboot.h - Multiboot (v1) boot information */
+#ifndef MULTIBOOT_H
+#define MULTIBOOT_H
+
+#include "types.h"
+#include "memory.h"
+
+#define MULTIBOOT_BOOTLOADER_MAGIC  0x2BADB002
+
+/* Bits in multiboot_info.flags */
+#define MBI_FLAG_MEM    0x001   /* mem_lower/mem_upper valid */
+#define MBI_FLAG_MMAP   0x040   /* mmap_length/mmap_addr valid */
+
+/* Memory map entry types */
+#define MMAP_AVAILABLE  1
+
+struct multiboot_info {
+    uint32_t flags;
+    uint32_t mem_lower;         /* KB of memory below 1 MB */
+    uint32_t mem_upper;         /* KB of memory above 1 MB */
+    uint32_t boot_device;
+    uint32_t cmdline;
+    uint32_t mods_count;
+    uint32_t mods_addr;
+    uint32_t syms[4];
+    uint32_t mmap_length;       /* Bytes of memory map */
+    uint32_t mmap_addr;         /* Physical address of first entry */
+} __attribute__((packed));
+
+struct multiboot_mmap_entry {
+    uint32_t size;              /* Size of the rest of this entry */
+    uint64_t addr;
+    uint64_t len;
+    uint32_t type;
+} __attribute__((packed));
+
+/* Collect available RAM at or above floor into ranges[] */
+int mbmemranges(uint32_t magic, struct multiboot_info *mbi, void *floor,
+                struct memrange *ranges, int maxranges);
+
+#endif
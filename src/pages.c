@@ -0,0 +1,276 @@
+/* pages.c - pginit, alloc_pages, free_pages */
+#include "types.h"
+#include "memory.h"
+#include "intr.h"
+
+/* Free page blocks link through their first two words */
+struct pgblk {
+    struct pgblk *pnext;
+    struct pgblk *pprev;
+};
+
+void *pgbase;                  /* Address of page frame 0 */
+uint32_t pgcount;              /* Frames covered by the allocator */
+uint32_t pgnfree;              /* Frames currently free */
+uint32_t pgnblk;               /* Blocks on the free lists */
+uint32_t pgtotal;              /* Frames handed out by pginit */
+
+static struct pgblk *pgfree[MAX_ORDER + 1];   /* Per-order free lists */
+static uint32_t *pgmap;                       /* Per-order free bitmaps */
+static uint32_t pgmapoff[MAX_ORDER + 1];      /* Bit offset of each order */
+
+/* Bitmap bit for block idx (in pages) at the given order */
+#define PGBIT(order, idx)  (pgmapoff[order] + ((idx) >> (order)))
+
+static int pgtest(int order, uint32_t idx)
+{
+    uint32_t bit = PGBIT(order, idx);
+    return (pgmap[bit >> 5] >> (bit & 31)) & 1;
+}
+
+static void pgpush(int order, uint32_t idx)
+{
+    struct pgblk *blk = (struct pgblk *)((uintptr_t)pgbase + idx * PAGE_SIZE);
+    uint32_t bit = PGBIT(order, idx);
+
+    blk->pprev = NULL;
+    blk->pnext = pgfree[order];
+    if (blk->pnext != NULL)
+        blk->pnext->pprev = blk;
+    pgfree[order] = blk;
+    pgmap[bit >> 5] |= 1u << (bit & 31);
+    pgnblk++;
+}
+
+static void pgunlink(int order, uint32_t idx)
+{
+    struct pgblk *blk = (struct pgblk *)((uintptr_t)pgbase + idx * PAGE_SIZE);
+    uint32_t bit = PGBIT(order, idx);
+
+    if (blk->pprev != NULL)
+        blk->pprev->pnext = blk->pnext;
+    else
+        pgfree[order] = blk->pnext;
+    if (blk->pnext != NULL)
+        blk->pnext->pprev = blk->pprev;
+    pgmap[bit >> 5] &= ~(1u << (bit & 31));
+    pgnblk--;
+}
+
+/*------------------------------------------------------------------------
+* pgorder - Smallest order whose block holds nbytes
+*------------------------------------------------------------------------
+*/
+int pgorder(
+    uint32_t nbytes /* Size in bytes */
+)
+{
+    int order = 0;
+
+    while (order < MAX_ORDER && ((uint32_t)PAGE_SIZE << order) < nbytes)
+        order++;
+    return order;
+}
+
+/* Free frames [lo, hi) as the largest naturally aligned blocks */
+static void pgaddrange(uint32_t lo, uint32_t hi)
+{
+    while (lo < hi)
+    {
+        int order = MAX_ORDER;
+
+        while ((lo & ((1u << order) - 1)) != 0 || lo + (1u << order) > hi)
+            order--;
+        pgpush(order, lo);
+        pgnfree += 1u << order;
+        lo += 1u << order;
+    }
+}
+
+/*------------------------------------------------------------------------
+* pginit - Hand the page frames in the usable ranges to the allocator
+*------------------------------------------------------------------------
+*/
+void pginit(
+    struct memrange *ranges, /* Usable physical ranges, ascending */
+    int nranges /* Number of ranges */
+)
+{
+    uintptr_t lo, hi;
+    uint32_t nbits, nmeta, metaidx;
+
+    /* Frame numbers span from the lowest to the highest usable byte;
+     * holes in between are simply never freed */
+    lo = (uintptr_t)-1;
+    hi = 0;
+    for (int i = 0; i < nranges; i++)
+    {
+        if (ranges[i].mrstart < lo)
+            lo = ranges[i].mrstart;
+        if (ranges[i].mrend > hi)
+            hi = ranges[i].mrend;
+    }
+    pgbase = (void *)((lo + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1));
+    pgcount = (hi > (uintptr_t)pgbase)
+              ? ((hi & ~(PAGE_SIZE - 1)) - (uintptr_t)pgbase) / PAGE_SIZE : 0;
+    pgnfree = 0;
+    pgnblk = 0;
+    pgtotal = 0;
+
+    /* One bitmap per order, packed back to back */
+    nbits = 0;
+    for (int order = 0; order <= MAX_ORDER; order++)
+    {
+        pgfree[order] = NULL;
+        pgmapoff[order] = nbits;
+        nbits += (pgcount >> order) + 1;
+    }
+    nmeta = ((nbits + 31) / 32 * sizeof(uint32_t) + PAGE_SIZE - 1) / PAGE_SIZE;
+
+    /* The bitmaps take the first frames of the first range big enough */
+    metaidx = pgcount;
+    for (int i = 0; i < nranges; i++)
+    {
+        uintptr_t first = (ranges[i].mrstart + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+        uintptr_t last = ranges[i].mrend & ~(PAGE_SIZE - 1);
+
+        if (last > first && (last - first) / PAGE_SIZE >= nmeta)
+        {
+            metaidx = (first - (uintptr_t)pgbase) / PAGE_SIZE;
+            break;
+        }
+    }
+    if (metaidx == pgcount)
+    {
+        pgcount = 0; /* Nowhere to keep the bitmaps */
+        return;
+    }
+    pgmap = (uint32_t *)((uintptr_t)pgbase + metaidx * PAGE_SIZE);
+    for (uint32_t w = 0; w < (nbits + 31) / 32; w++)
+        pgmap[w] = 0;
+
+    for (int i = 0; i < nranges; i++)
+    {
+        uintptr_t first = (ranges[i].mrstart + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+        uintptr_t last = ranges[i].mrend & ~(PAGE_SIZE - 1);
+
+        if (last <= first)
+            continue;
+        first = (first - (uintptr_t)pgbase) / PAGE_SIZE;
+        last = (last - (uintptr_t)pgbase) / PAGE_SIZE;
+        if (first == metaidx)
+            first += nmeta;
+        pgaddrange(first, last);
+    }
+    pgtotal = pgnfree;
+}
+
+/*------------------------------------------------------------------------
+* pgmaxorder - Highest order with a free block, or -1 if none
+*------------------------------------------------------------------------
+*/
+int pgmaxorder(void)
+{
+    int order = MAX_ORDER;
+
+    while (order >= 0 && pgfree[order] == NULL)
+        order--;
+    return order;
+}
+
+/*------------------------------------------------------------------------
+* alloc_pages - Allocate 2^order contiguous, page-aligned frames
+*------------------------------------------------------------------------
+*/
+void *alloc_pages(
+    int order /* log2 of the number of pages */
+)
+{
+    intmask mask; /* Saved interrupt mask */
+    uint32_t idx;
+    int k;
+    mask = disable();
+    if (order < 0 || order > MAX_ORDER)
+    {
+        restore(mask);
+        return NULL;
+    }
+
+    /* Smallest order with a free block */
+    for (k = order; k <= MAX_ORDER && pgfree[k] == NULL; k++)
+        ;
+    if (k > MAX_ORDER)
+    {
+        pgordcount[order].nfail++;
+        restore(mask);
+        return NULL;
+    }
+    idx = ((uintptr_t)pgfree[k] - (uintptr_t)pgbase) / PAGE_SIZE;
+    pgunlink(k, idx);
+
+    /* Split, returning upper halves to the lower orders */
+    while (k > order)
+    {
+        k--;
+        pgpush(k, idx + (1u << k));
+    }
+    pgnfree -= 1u << order;
+    pgordcount[order].nalloc++;
+    MEMUSE((uint32_t)PAGE_SIZE << order);
+    restore(mask);
+    return (void *)((uintptr_t)pgbase + idx * PAGE_SIZE);
+}
+
+/*------------------------------------------------------------------------
+* free_pages - Return a block from alloc_pages, merging with its buddies
+*------------------------------------------------------------------------
+*/
+int free_pages(
+    void *addr, /* Address returned by alloc_pages */
+    int order /* Order it was allocated with */
+)
+{
+    intmask mask; /* Saved interrupt mask */
+    uint32_t idx;
+    mask = disable();
+    if (order < 0 || order > MAX_ORDER
+            || (uintptr_t)addr < (uintptr_t)pgbase
+            || ((uintptr_t)addr & (PAGE_SIZE - 1)) != 0)
+    {
+        restore(mask);
+        return -1;
+    }
+    idx = ((uintptr_t)addr - (uintptr_t)pgbase) / PAGE_SIZE;
+    if ((idx & ((1u << order) - 1)) != 0 || idx + (1u << order) > pgcount)
+    {
+        restore(mask);
+        return -1;
+    }
+    /* Refuse if the block or any block containing it is already free */
+    for (int k = order; k <= MAX_ORDER; k++)
+    {
+        if (pgtest(k, idx & ~((1u << k) - 1)))
+        {
+            restore(mask);
+            return -1;
+        }
+    }
+    pgnfree += 1u << order;
+    pgordcount[order].nfree++;
+    MEMUNUSE((uint32_t)PAGE_SIZE << order);
+
+    /* Merge upward while the buddy is free at the same order */
+    while (order < MAX_ORDER)
+    {
+        uint32_t buddy = idx ^ (1u << order);
+
+        if (buddy + (1u << order) > pgcount || !pgtest(order, buddy))
+            break;
+        pgunlink(order, buddy);
+        idx &= ~(1u << order);
+        order++;
+    }
+    pgpush(order, idx);
+    restore(mask);
+    return 0;
+}
@@ -0,0 +1,193 @@
+/* paging.c - vminit, vmmapio, vmfault, vmrefill, vmtlbsync, vmstkreset */
+#include "types.h"
+#include "memory.h"
+#include "paging.h"
+#include "string.h"
+#include "x86.h"
+#include "smp.h"
+
+static uint32_t pgdir[1024] __attribute__((aligned(PAGE_SIZE)));
+
+/* Page tables covering the stack area, one per directory entry */
+static uint32_t *stkpt[(NPOOLSTK * POOLSTKSIZE + PDSPAN - 1) / PDSPAN];
+
+/* Bumped whenever a stack page is unmapped; other CPUs may still
+ * cache the old translation until they flush (vmtlbsync) */
+static uint32_t vmtlbgen;
+
+/* Reserve of painted frames for vmfault */
+static void *vmres[VMNRES];
+static volatile int vmnres;
+
+/* Page table entry for a stack-area address */
+static uint32_t *stkpte(uint32_t va)
+{
+    return &stkpt[(va - STKVBASE) / PDSPAN][(va >> 12) & 1023];
+}
+
+static void zeropage(void *page)
+{
+    memset(page, 0, PAGE_SIZE);
+}
+
+/*------------------------------------------------------------------------
+* vminit - Build the page directory and turn paging on
+*------------------------------------------------------------------------
+*/
+void vminit(void)
+{
+    uint32_t top, va;
+
+    /* Identity map RAM (and everything below it) with 4 MB pages */
+    top = (uint32_t)pgbase + pgcount * PAGE_SIZE;
+    top = (top + PDSPAN - 1) & ~(PDSPAN - 1);
+    if (top == 0 || top > STKVBASE)
+        top = STKVBASE;
+    for (va = 0; va < top; va += PDSPAN)
+        pgdir[va / PDSPAN] = va | PTE_PS | PTE_W | PTE_P;
+
+    /* The stack area uses 4 KB pages so it can be faulted in */
+    for (uint32_t i = 0; i < sizeof(stkpt) / sizeof(stkpt[0]); i++)
+    {
+        stkpt[i] = (uint32_t *)alloc_pages(0);
+        zeropage(stkpt[i]);
+        pgdir[(STKVBASE + i * PDSPAN) / PDSPAN] =
+            (uint32_t)stkpt[i] | PTE_W | PTE_P;
+    }
+    vmrefill();
+
+    /* A task switch loads CR3 from the incoming TSS */
+    for (int i = 0; i < NCPU; i++) {
+        cpus[i].tss.cr3 = (uint32_t)pgdir;
+        cpus[i].pftss.cr3 = (uint32_t)pgdir;
+    }
+
+    write_cr4(read_cr4() | CR4_PSE);
+    write_cr3((uint32_t)pgdir);
+    write_cr0(read_cr0() | CR0_PG | CR0_WP);
+
+    pstkinit((void *)STKVBASE, NPOOLSTK);
+}
+
+/*------------------------------------------------------------------------
+* vmmapio - Identity map the 4 MB around a device's registers, uncached
+*------------------------------------------------------------------------
+*/
+void vmmapio(
+    uint32_t pa /* Physical address of the registers */
+)
+{
+    pa &= ~(PDSPAN - 1);
+    pgdir[pa / PDSPAN] = pa | PTE_PS | PTE_PCD | PTE_PWT | PTE_W | PTE_P;
+    invlpg((void *)pa);
+}
+
+/*------------------------------------------------------------------------
+* vmrefill - Top up the fault reserve (call outside the fault path)
+*------------------------------------------------------------------------
+*/
+void vmrefill(void)
+{
+    while (vmnres < VMNRES)
+    {
+        void *frame = alloc_pages(0);
+
+        if (frame == NULL)
+            return;
+        memset(frame, STKPAINT, PAGE_SIZE); /* Fresh stack: painted */
+        vmres[vmnres] = frame;
+        vmnres++;
+    }
+}
+
+/*------------------------------------------------------------------------
+* vmtlbsync - Flush this CPU's TLB if a stack page was unmapped since it
+*             last did. Only the slot's next owner touches those
+*             addresses, and it runs here only after schedule(), which
+*             calls this first: no shootdown IPI is needed.
+*------------------------------------------------------------------------
+*/
+void vmtlbsync(void)
+{
+    struct cpu *c = mycpu();
+
+    if (c->tlbgen != vmtlbgen) {
+        c->tlbgen = vmtlbgen;
+        write_cr3(read_cr3());
+    }
+}
+
+/*------------------------------------------------------------------------
+* vmfault - Map a reserve frame at addr if it is a growable stack page
+*------------------------------------------------------------------------
+*/
+int vmfault(
+    uint32_t addr /* Faulting address (CR2) */
+)
+{
+    uint32_t *pte;
+
+    if (addr < STKVBASE || addr >= STKVEND)
+        return -1; /* Not a stack */
+    if ((addr - STKVBASE) % POOLSTKSIZE < PAGE_SIZE)
+        return -1; /* Guard page: stack overflow */
+    pte = stkpte(addr);
+    if (*pte & PTE_P)
+        return -1; /* Present already: a protection fault */
+    if (vmnres == 0)
+        return -1; /* Out of frames */
+    vmnres--;
+    *pte = (uint32_t)vmres[vmnres] | PTE_W | PTE_P;
+    return 0;
+}
+
+/*------------------------------------------------------------------------
+* vmmapped - Nonzero if a stack-area address has a frame behind it
+*------------------------------------------------------------------------
+*/
+int vmmapped(
+    void *va /* Address in the stack area */
+)
+{
+    if ((uint32_t)va < STKVBASE || (uint32_t)va >= STKVEND)
+        return 1; /* Identity mapped */
+    return (*stkpte((uint32_t)va) & PTE_P) != 0;
+}
+
+/*------------------------------------------------------------------------
+* vmstkreset - Leave only the top page of a stack slot mapped
+*------------------------------------------------------------------------
+*/
+int vmstkreset(
+    void *stktop /* Highest word address of the slot */
+)
+{
+    uint32_t top = (uint32_t)stktop & ~(PAGE_SIZE - 1);
+    uint32_t base = top + PAGE_SIZE - POOLSTKSIZE;
+    uint32_t *pte;
+
+    /* Release whatever the previous owner grew into */
+    for (uint32_t va = base + PAGE_SIZE; va < top; va += PAGE_SIZE)
+    {
+        pte = stkpte(va);
+        if (*pte & PTE_P)
+        {
+            free_pages((void *)(*pte & ~(PAGE_SIZE - 1)), 0);
+            *pte = 0;
+            invlpg((void *)va);
+            vmtlbgen++;
+        }
+    }
+
+    pte = stkpte(top);
+    if (!(*pte & PTE_P))
+    {
+        void *frame = alloc_pages(0);
+
+        if (frame == NULL)
+            return -1;
+        zeropage(frame);
+        *pte = (uint32_t)frame | PTE_W | PTE_P;
+    }
+    return 0;
+}
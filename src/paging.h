@@ -0,0 +1,38 @@
+/* paging.h - Identity-mapped kernel and demand-paged process stacks */
+#ifndef PAGING_H
+#define PAGING_H
+
+#include "types.h"
+#include "memory.h"
+
+/*
+ * RAM is identity mapped with 4 MB pages up to MAXPHYSADDR. Above
+ * that sits the stack area: NPOOLSTK slots of POOLSTKSIZE bytes, each
+ * with its lowest page left unmapped as a guard. Other pages of a slot
+ * are mapped the first time they are touched.
+ */
+#define STKVBASE    MAXPHYSADDR
+#define STKVEND     (STKVBASE + NPOOLSTK * POOLSTKSIZE)
+
+#define PTE_P       0x001   /* Present */
+#define PTE_W       0x002   /* Writable */
+#define PTE_PWT     0x008   /* Write-through */
+#define PTE_PCD     0x010   /* Cache disabled */
+#define PTE_PS      0x080   /* 4 MB page (directory entries only) */
+
+#define PDSPAN      0x400000    /* Bytes mapped by one directory entry */
+
+/* Frames kept ready for the page-fault task, which must not call
+ * alloc_pages: the fault may have interrupted it. One slot's worth,
+ * so a process can grow to its full stack within one time slice. */
+#define VMNRES      (POOLSTKSIZE / PAGE_SIZE)
+
+void vminit(void);
+void vmmapio(uint32_t pa);
+void vmrefill(void);
+void vmtlbsync(void);
+int vmfault(uint32_t addr);
+int vmmapped(void *va);
+int vmstkreset(void *stktop);
+
+#endif
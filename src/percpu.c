@@ -0,0 +1,62 @@
+/* percpu.c - cpus[], ncpu and smp_report */
+#include "types.h"
+#include "serial.h"
+#include "intr.h"
+#include "smp.h"
+
+/* getcurrpid() reads this word directly */
+_Static_assert(__builtin_offsetof(struct cpu, runpid) == CPU_CURRPID,
+               "CPU_CURRPID out of step with struct cpu");
+
+struct cpu cpus[NCPU];
+int ncpu = 1;           /* smp_init adds the others in kernel-smp.elf */
+
+/*------------------------------------------------------------------------
+* smp_report - Print what each CPU is running, how often it switched
+*              and stole work, and the EDF processes it has admitted
+*------------------------------------------------------------------------
+*/
+void smp_report(void)
+{
+    intmask mask; /* Saved interrupt mask */
+    struct {
+        int apicid, runpid;
+        uint32_t rq_ready, nswitch, nsteal, rtutil;
+        int nrt;
+    } snap[NCPU];
+    int n;
+
+    /* Copy under the lock, print without it */
+    mask = disable();
+    n = ncpu;
+    for (int i = 0; i < n; i++) {
+        snap[i].apicid = cpus[i].apicid;
+        snap[i].runpid = cpus[i].runpid;
+        snap[i].rq_ready = cpus[i].rq_ready;
+        snap[i].nswitch = cpus[i].nswitch;
+        snap[i].nsteal = cpus[i].nsteal;
+        snap[i].nrt = cpus[i].nrt;
+        snap[i].rtutil = cpus[i].rtutil;
+    }
+    restore(mask);
+
+    for (int i = 0; i < n; i++) {
+        serial_puts("cpu ");
+        serial_putdec(i);
+        serial_puts(": apic ");
+        serial_putdec(snap[i].apicid);
+        serial_puts(" pid ");
+        serial_putdec(snap[i].runpid);
+        serial_puts(" queued ");
+        serial_puthex32(snap[i].rq_ready);
+        serial_puts(" switches ");
+        serial_putdec(snap[i].nswitch);
+        serial_puts(" steals ");
+        serial_putdec(snap[i].nsteal);
+        serial_puts(" edf ");
+        serial_putdec(snap[i].nrt);
+        serial_puts(" at ");
+        serial_putdec(snap[i].rtutil / 10);
+        serial_puts("%\n");
+    }
+}
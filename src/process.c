@@ -5,6 +5,10 @@
 #include "memory.h"
 #include "process.h"
 #include "scheduler.h"
+#include "intr.h"
+#include "smp.h"
+#include "x86.h"
+#include "trace.h"
 
 /* Forward declaration of null_idle (defined in kernel.c) */
 extern void null_idle(void);
@@ -13,8 +17,49 @@ extern void null_idle(void);
  * Global process table
  * ----------------------------- */
 
-struct pcb proctab[NPROC];
-int currpid = NULLPROC;
+struct pcb *pcbdir[NPCBDIR];
+int npid = 0;
+
+/* Free PCBs, oldest first, so a PID is reused as late as possible */
+static struct pcb *pcbfree;
+static struct pcb *pcbfreetail;
+
+static void pcbput(struct pcb *p)
+{
+    p->state = PR_FREE;
+    p->qnext = NULL;
+    if (pcbfreetail != NULL)
+        pcbfreetail->qnext = p;
+    else
+        pcbfree = p;
+    pcbfreetail = p;
+}
+
+_Static_assert((PCBCHUNK & (PCBCHUNK - 1)) == 0, "PCBCHUNK is a power of two");
+_Static_assert(PCBCHUNK * sizeof(struct pcb) <= PAGE_SIZE, "a PCB chunk fits its page");
+
+/* Add a chunk of PCBs to the free list */
+static int pcbgrow(void)
+{
+    struct pcb *chunk;
+
+    if (npid / PCBCHUNK >= NPCBDIR)
+        return -1; /* PID space exhausted */
+
+    chunk = alloc_pages(pgorder(PCBCHUNK * sizeof(struct pcb)));
+    if (chunk == NULL)
+        return -1;
+    memset(chunk, 0, PCBCHUNK * sizeof(struct pcb));
+
+    pcbdir[npid / PCBCHUNK] = chunk;
+    for (int i = 0; i < PCBCHUNK; i++)
+    {
+        chunk[i].pid = npid + i;
+        pcbput(&chunk[i]);
+    }
+    npid += PCBCHUNK;
+    return 0;
+}
 
 /* -----------------------------
  * Internal helper: allocate PID
@@ -22,21 +67,17 @@ int currpid = NULLPROC;
 
 static int alloc_pid(void)
 {
-    static int nextpid = 1; /* PID 0 is reserved for null process */
+    struct pcb *p;
 
-    for (int i = 0; i < NPROC; i++)
-    {
-        int pid = nextpid;
-        nextpid = (nextpid + 1) % NPROC;
+    if (pcbfree == NULL && pcbgrow() != 0)
+        return -1; /* no free PID */
 
-        if (pid == NULLPROC)
-            continue;
-
-        if (proctab[pid].state == PR_FREE)
-            return pid;
-    }
-
-    return -1; /* no free PID */
+    p = pcbfree;
+    pcbfree = p->qnext;
+    if (pcbfree == NULL)
+        pcbfreetail = NULL;
+    p->pgen++;
+    return p->pid;
 }
 
 /* -----------------------------
@@ -45,26 +86,39 @@ static int alloc_pid(void)
 
 void process_init(void)
 {
-    for (int i = 0; i < NPROC; i++)
-    {
-        proctab[i].state = PR_FREE;
-    }
+    npid = 0;
+    pcbfree = pcbfreetail = NULL;
 
-    /* Initialize NULL process with proper stack setup */
-    proctab[NULLPROC].pid = NULLPROC;
-    proctab[NULLPROC].state = PR_CURR;
-    proctab[NULLPROC].priority = 0;
-    proctab[NULLPROC].wait_ticks = 0;
+    /* The first PID handed out is NULLPROC */
+    alloc_pid();
 
+    /* Initialize NULL process with proper stack setup */
+    proctab(NULLPROC)->state = PR_CURR;
+    proctab(NULLPROC)->pflags = PF_IDLE;
+    proctab(NULLPROC)->pcpu = 0;
+    proctab(NULLPROC)->priority = 0;
+    proctab(NULLPROC)->rq_stamp = 0;
+    proctab(NULLPROC)->rtperiod = 0;
+    proctab(NULLPROC)->arena = NULL;
+    proctab(NULLPROC)->fxarea = NULL;
+    memset(&proctab(NULLPROC)->pcount, 0, sizeof(struct pcount));
+    proctab(NULLPROC)->pstamp = rdtsc();
+
+#ifdef KACCHI_HOSTED
+    /* host/schedsim.c: NULLPROC is the simulator's own context */
+    proctab(NULLPROC)->sp = NULL;
+    proctab(NULLPROC)->stack_base = NULL;
+    proctab(NULLPROC)->stack_size = 0;
+#else
     /* Allocate a proper stack for NULL process */
     void *stack = getstk(NULL_STACK_SIZE);
     if (stack == NULL) {
         /* Fall back to current kernel ESP if allocation fails */
         uint32_t *esp;
         __asm__ volatile("movl %%esp, %0" : "=r"(esp));
-        proctab[NULLPROC].sp = esp;
-        proctab[NULLPROC].stack_base = NULL;
-        proctab[NULLPROC].stack_size = 0;
+        proctab(NULLPROC)->sp = esp;
+        proctab(NULLPROC)->stack_base = NULL;
+        proctab(NULLPROC)->stack_size = 0;
     } else {
         /* Set up NULL process stack with null_idle entry */
         uint32_t *sp = (uint32_t *)((uint32_t)stack & ~0xF);
@@ -72,8 +126,9 @@ void process_init(void)
         /* Bottom-most return: if null_idle() returns */
         *(--sp) = (uint32_t)process_exit;
 
-        /* Return address for ctx_switch → ret */
+        /* Entry, reached through the sti trampoline */
         *(--sp) = (uint32_t)null_idle;
+        *(--sp) = (uint32_t)proc_start;
 
         /* Fake callee-saved registers (MUST match pop order) */
         *(--sp) = 0; // EBP
@@ -81,45 +136,101 @@ void process_init(void)
         *(--sp) = 0; // ESI
         *(--sp) = 0; // EDI
 
-        proctab[NULLPROC].sp = sp;
-        proctab[NULLPROC].stack_base = stack;
-        proctab[NULLPROC].stack_size = NULL_STACK_SIZE;
+        proctab(NULLPROC)->sp = sp;
+        proctab(NULLPROC)->stack_base = stack;
+        proctab(NULLPROC)->stack_size = NULL_STACK_SIZE;
     }
+#endif
 }
 
-/* -----------------------------
- * Create a new process
- * ----------------------------- */
-
-int process_create(void (*entry)(void), const char *name)
+/*------------------------------------------------------------------------
+ * process_create_ex - Create a process that starts at entry(arg) with
+ *                     priority prio. A stack of up to a pool slot
+ *                     (less its guard page) comes from the stack pool,
+ *                     a larger one, or any when the pool is empty,
+ *                     from the heap. stksize 0 takes the whole slot,
+ *                     or PROC_STACK_SIZE from the heap.
+ *------------------------------------------------------------------------
+ */
+int process_create_ex(
+    void (*entry)(void *),  /* Code the process runs */
+    const char *name,       /* Under PNMLEN characters, or NULL */
+    uint32_t stksize,       /* Stack bytes, 0 for the default */
+    int prio,               /* Priority, 0..MAX_PRIO-1 */
+    void *arg               /* Passed to entry */
+)
 {
+    intmask mask; /* Saved interrupt mask */
     int pid;
-    void *stack;
+    void *stack = NULL;
+    uint32_t want = stksize;
 
-    if (entry == NULL)
+    if (entry == NULL || prio < 0 || prio >= MAX_PRIO)
         return -1;
+    if (stksize != 0 && stksize < MINSTK)
+        stksize = MINSTK;
 
+    mask = disable();
     pid = alloc_pid();
-    if (pid < 0)
+    if (pid < 0) {
+        restore(mask);
+        return -1;
+    }
+    if (mboxinit(pid) != 0) {
+        pcbput(proctab(pid));
+        restore(mask);
         return -1;
+    }
 
-    stack = getstk(PROC_STACK_SIZE);
+    /* Pooled (guarded, demand-paged) stack first; fall back to the
+     * heap when the pool is empty or the stack would not fit */
+    if (stksize <= POOLSTKSIZE - PAGE_SIZE)
+    {
+        stack = getpstk();
+        if (want == 0)
+            stksize = POOLSTKSIZE - PAGE_SIZE;
+    }
     if (stack == NULL)
+    {
+        if (want == 0)
+            stksize = PROC_STACK_SIZE;
+        stack = getstk(stksize);
+    }
+    if (stack == NULL) {
+        mboxfree(pid);
+        pcbput(proctab(pid));
+        restore(mask);
         return -1;
+    }
 
-    /* Initialize PCB */
-    proctab[pid].pid = pid;
-    proctab[pid].state = PR_READY;
-    proctab[pid].priority = DEFAULT_PRIO;
-    proctab[pid].wait_ticks = 0;
-
+    /* Initialize PCB; it starts on the creating CPU's queue */
+    proctab(pid)->pflags = 0;
+    proctab(pid)->pcpu = mycpu()->cpuid;
+    proctab(pid)->priority = prio;
+    proctab(pid)->rq_stamp = 0;
+    proctab(pid)->rtperiod = 0;
+    proctab(pid)->arena = NULL;
+    proctab(pid)->fxarea = NULL;
+    memset(&proctab(pid)->pcount, 0, sizeof(struct pcount));
+    proctab(pid)->pstamp = rdtsc();
+    proctab(pid)->stack_base = stack;
+    proctab(pid)->stack_size = roundmb(stksize);
+    stkpaint(pid);
+
+#ifdef KACCHI_HOSTED
+    /* host/schedsim.c runs each process on a context of its own */
+    proctab(pid)->sp = hostctx(pid, entry, arg);
+#else
     uint32_t *sp = (uint32_t *)((uint32_t)stack & ~0xF);
 
-    /* Bottom-most return: if entry() returns */
+    /* entry's argument, then its return address: if entry() returns */
+    *(--sp) = (uint32_t)arg;
     *(--sp) = (uint32_t)process_exit;
 
-    /* Return address for ctx_switch → ret */
+    /* Entry, reached through the sti trampoline: ctx_switch runs
+     * with interrupts off */
     *(--sp) = (uint32_t)entry;
+    *(--sp) = (uint32_t)proc_start;
 
     /* Fake callee-saved registers (MUST match pop order) */
     *(--sp) = 0; // EBP
@@ -127,22 +238,72 @@ int process_create(void (*entry)(void), const char *name)
     *(--sp) = 0; // ESI
     *(--sp) = 0; // EDI
 
-    proctab[pid].sp = sp;
-
-    proctab[pid].stack_base = stack;
-    proctab[pid].stack_size = PROC_STACK_SIZE;
+    proctab(pid)->sp = sp;
+#endif
 
     /* Copy process name */
     if (name)
     {
-        strcpy(proctab[pid].name, name);
-        proctab[pid].name[PNMLEN - 1] = '\0';
+        strcpy(proctab(pid)->name, name);
+        proctab(pid)->name[PNMLEN - 1] = '\0';
     }
     else
     {
-        proctab[pid].name[0] = '\0';
+        proctab(pid)->name[0] = '\0';
     }
 
+    ready(pid);
+    restore(mask);
+    return pid;
+}
+
+/* -----------------------------
+ * Create a new process
+ * ----------------------------- */
+
+int process_create(void (*entry)(void), const char *name)
+{
+    /* Taking no argument, entry ignores the one it is passed */
+    return process_create_ex((void (*)(void *))entry, name, 0,
+                             DEFAULT_PRIO, NULL);
+}
+
+/*------------------------------------------------------------------------
+ * idle_create - Give a starting CPU its idle process. The CPU is already
+ *               running on stack, so no frame is built: the first
+ *               ctx_switch away from it saves its sp.
+ *------------------------------------------------------------------------
+ */
+int idle_create(
+    int cpu,            /* Index in cpus[] */
+    void *stack,        /* Highest word of the CPU's boot stack */
+    uint32_t stksize    /* Its size in bytes */
+)
+{
+    intmask mask; /* Saved interrupt mask */
+    int pid;
+
+    mask = disable();
+    pid = alloc_pid();
+    if (pid < 0) {
+        restore(mask);
+        return -1;
+    }
+    proctab(pid)->state = PR_CURR;
+    proctab(pid)->pflags = PF_IDLE;
+    proctab(pid)->pcpu = cpu;
+    proctab(pid)->priority = NULL_PRIO;
+    proctab(pid)->rq_stamp = 0;
+    proctab(pid)->rtperiod = 0;
+    proctab(pid)->arena = NULL;
+    proctab(pid)->fxarea = NULL;
+    memset(&proctab(pid)->pcount, 0, sizeof(struct pcount));
+    proctab(pid)->pstamp = rdtsc();
+    proctab(pid)->sp = NULL;
+    proctab(pid)->stack_base = stack;
+    proctab(pid)->stack_size = stksize;
+    strcpy(proctab(pid)->name, "idle");
+    restore(mask);
     return pid;
 }
 
@@ -154,24 +315,41 @@ void process_exit(void)
 {
     int pid = currpid;
 
-    /* Null process must never exit */
-    if (pid == NULLPROC)
+    /* Idle processes must never exit */
+    if (isidle(pid))
         return;
 
-    /* Free process stack */
-    if (proctab[pid].stack_base != NULL)
+    /* Not restored: schedule() never comes back to this process */
+    disable();
+
+    /* Free process stack (back to the pool if it came from there) */
+    if (proctab(pid)->stack_base != NULL
+            && freepstk(proctab(pid)->stack_base) != 0)
     {
-        freestk(proctab[pid].stack_base,
-                proctab[pid].stack_size);
+        freestk(proctab(pid)->stack_base,
+                proctab(pid)->stack_size);
     }
 
+    /* Release everything the process allocated from its arena */
+    arenarelease(&proctab(pid)->arena);
+
+    /* Drop queued messages; parked senders get an error */
+    mboxfree(pid);
+
+    /* Its FPU state, if it ever used the FPU */
+    fpu_release(pid);
+
+    /* Its share of the CPU's real-time capacity */
+    if (proctab(pid)->rtperiod != 0)
+        rt_clear();
+
     /* Mark PCB free */
-    proctab[pid].state = PR_FREE;
-    // proctab[pid].entry = NULL;
-    proctab[pid].sp = NULL;
-    proctab[pid].stack_base = NULL;
-    proctab[pid].stack_size = 0;
-    proctab[pid].name[0] = '\0';
+    // proctab(pid)->entry = NULL;
+    proctab(pid)->sp = NULL;
+    proctab(pid)->stack_base = NULL;
+    proctab(pid)->stack_size = 0;
+    proctab(pid)->name[0] = '\0';
+    pcbput(proctab(pid));
 
     /* Control will return to scheduler later */
     schedule();
@@ -187,7 +365,7 @@ int getpstate(int pid)
     if (isbadpid(pid))
         return -1;
 
-    return proctab[pid].state;
+    return proctab(pid)->state;
 }
 
 const char *getpname(int pid)
@@ -195,43 +373,57 @@ const char *getpname(int pid)
     if (isbadpid(pid))
         return NULL;
 
-    return proctab[pid].name;
+    return proctab(pid)->name;
 }
 
 void block_current(void)
 {
+    intmask mask; /* Saved interrupt mask */
     int pid = currpid;
 
-    /* Null process must never block */
-    if (pid == NULLPROC)
+    /* Idle processes must never block */
+    if (isidle(pid))
         return;
 
-    /* Mark process as blocked */
-    proctab[pid].state = PR_BLOCKED;
+    mask = disable();
 
-    /* Give up CPU */
-    yield();
+    /* Mark process as blocked; it stays off the ready queues */
+    proctab(pid)->state = PR_BLOCKED;
+    trace(TR_BLOCK, pid, 0);
+
+    /* Give up CPU until wakeup() */
+    schedule();
+    restore(mask);
 }
 int wakeup(int pid)
 {
-    if (isbadpid(pid))
-        return -1;
+    intmask mask; /* Saved interrupt mask */
 
-    if (proctab[pid].state != PR_BLOCKED)
+    mask = disable();
+    if (isbadpid(pid) || proctab(pid)->state != PR_BLOCKED) {
+        restore(mask);
         return -1;
+    }
 
     /* Make process ready again */
-    proctab[pid].state = PR_READY;
+    ready(pid);
 
+    restore(mask);
     return 0;
 }
 
 int set_priority(int pid, int prio)
 {
-    if (isbadpid(pid) || prio < 0)
+    intmask mask; /* Saved interrupt mask */
+
+    mask = disable();
+    if (isbadpid(pid) || prio < 0) {
+        restore(mask);
         return -1;
+    }
 
-    proctab[pid].priority = prio;
+    proctab(pid)->priority = prio;
+    restore(mask);
     return 0;
 }
 int get_priority(int pid)
@@ -239,35 +431,10 @@ int get_priority(int pid)
     if (isbadpid(pid))
         return -1;
 
-    return proctab[pid].priority;
+    return proctab(pid)->priority;
 }
 
-int send(int pid, msg_t msg)
+void *getpmem(uint32_t nbytes)
 {
-    if (isbadpid(pid))
-        return -1;
-
-    if (proctab[pid].has_msg)
-        return -1;
-
-    proctab[pid].msg = msg;
-    proctab[pid].has_msg = 1;
-
-    if (proctab[pid].state == PR_BLOCKED)
-        wakeup(pid);
-
-    return 0;
-}
-
-msg_t receive(void)
-{
-    int pid = currpid;
-
-    while (!proctab[pid].has_msg)
-    {
-        block_current(); // PR_BLOCKED
-    }
-
-    proctab[pid].has_msg = 0;
-    return proctab[pid].msg;
+    return arenaalloc(&proctab(currpid)->arena, nbytes);
 }
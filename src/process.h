@@ -4,13 +4,22 @@
 #define PROCESS_H
 
 #include "types.h"
+#include "memory.h"
 
 /* -----------------------------
  * System-wide process limits
  * ----------------------------- */
 
-/* Maximum number of processes */
-#define NPROC       8
+/* PCBs are allocated a page at a time, as processes are created: a
+ * chunk of PCBCHUNK PCBs. It is a power of two, so proctab() is a
+ * shift and a mask rather than a divide; 16 of today's 192-byte PCBs
+ * fill three quarters of the page. pcbdir maps pid / PCBCHUNK to its
+ * chunk, so the PID space, NPROC, is NPCBDIR * PCBCHUNK = PIDMAX; only
+ * live chunks take memory. */
+#define PIDMAX      16384
+#define PCBCHUNK    16
+#define NPCBDIR     (PIDMAX / PCBCHUNK)
+#define NPROC       (NPCBDIR * PCBCHUNK)
 
 /* Process name length */
 #define PNMLEN      16
@@ -18,14 +27,23 @@
 /* PID of the null (idle) process */
 #define NULLPROC    0
 
-/* Default stack size for processes (bytes) */
+/* Stack size for processes (bytes) when the stack pool is empty and
+ * the stack has to come from the heap; pooled stacks can grow to
+ * POOLSTKSIZE less the guard page */
 #define PROC_STACK_SIZE  4096
 
 #define DEFAULT_PRIO 1
 #define NULL_PRIO    0
+#define MAX_PRIO     8   /* Priorities are 0..MAX_PRIO-1 for scheduling */
+
+/* Real-time (EDF) processes each CPU admits (edf.c) */
+#define NRTPROC     32
 
 #define NULL_STACK_SIZE 4096
 
+/* Smallest stack process_create_ex hands out; smaller requests grow */
+#define MINSTK      256
+
 /* -----------------------------
  * Process states
  * ----------------------------- */
@@ -34,33 +52,94 @@
 #define PR_READY    1   /* Process is ready to run */
 #define PR_CURR     2   /* Process is currently running */
 #define PR_TERM     3   /* Process has terminated */
-#define PR_SLEEP    4
+#define PR_SLEEP    4   /* Process is on the timing wheel */
 #define PR_BLOCKED  5
+#define PR_RECV     6   /* Waiting for a message */
+#define PR_SEND     7   /* Parked on a full mailbox */
+#define PR_WAIT     8   /* On a wait queue (sync.h) */
+#define PR_RTWAIT   9   /* Real-time: out of budget, or done, until its next period */
+
+/* pflags */
+#define PF_IDLE     0x0001  /* A CPU's idle process: never queued, never blocks */
+#define PF_STKOVF   0x0002  /* Ran past its stack limit (reported once) */
+#define PF_PREEMPT  0x0004  /* The tick took the CPU away (involuntary) */
 
 typedef int msg_t;
+
+/* Messages a mailbox holds; a power of two.
+ * Override with make CFLAGS+=-DMBOXDEPTH=... */
+#ifndef MBOXDEPTH
+#define MBOXDEPTH   16
+#endif
+/* Resource use, kept by the scheduler and mailboxes (pstat.c) */
+struct pcount {
+    uint64_t cycles;        /* TSC cycles on a CPU */
+    uint64_t readycyc;      /* Cycles queued, waiting for a CPU */
+    uint64_t blockcyc;      /* Cycles blocked: sleep, receive, wait... */
+    uint32_t nvol;          /* Gave up the CPU: blocked or yielded */
+    uint32_t ninvol;        /* Had it taken away by the tick */
+    uint32_t nsent;         /* Messages sent */
+    uint32_t nrecv;         /* Messages received */
+};
+
 /* -----------------------------
  * Process Control Block (PCB)
  * ----------------------------- */
 
 struct pcb {
-    int         pid;                    /* Process ID */
+    /* Hot: read or written on every switch; first cache line */
+    uint32_t      *sp;              /* Saved stack pointer */
     uint16_t    state;                  /* Process state */
+    uint16_t    tslot;      /* Timing-wheel slot while PR_SLEEP */
     int priority;
-    int wait_ticks;
+    uint32_t rq_stamp;      /* CPU epoch when last queued (aging) */
+    struct pcb *qnext;      /* Ready queue, timing-wheel slot, or free */
+    struct pcb *qprev;      /* list, depending on state */
+    int         pid;                    /* Process ID */
+    uint32_t    twake;      /* clkticks to wake at while PR_SLEEP */
+    uint16_t    pcpu;       /* CPU it last ran on; ready() queues it there */
+    uint16_t    pflags;     /* PF_* */
 
     /* Stack management */
-    uint32_t      *sp;              /* Saved stack pointer */
-    void       *stack_base;             /* Base (lowest addr) of stack */
-    uint32_t    stack_size;             /* Stack size in bytes */
-    msg_t msg;        /* message */
-    int has_msg;      /* 0 = no message, 1 = message available */
+    void       *stack_base;             /* Highest word of the stack */
+    uint32_t    stack_size;             /* Usable bytes below and including it */
+    /* Per-process arena, released in bulk by process_exit */
+    struct archunk *arena;
+
+    /* FPU/SSE state (fpu.c): an FXSAVE image from getmem, NULL until
+     * the process first touches the FPU */
+    void *fxarea;
+    uint16_t fpucpu;        /* CPU whose registers last loaded it */
+    uint16_t pgen;          /* Bumped each time the PID is handed out */
+
+    /* Accounting: pstamp is the TSC when it last started running,
+     * waiting on a queue, or blocking */
+    struct pcount pcount;
+    uint64_t pstamp;
+
+    /* Real-time class (edf.c), in clock ticks; rtperiod is 0 for a
+     * best-effort process */
+    uint32_t rtperiod;      /* Between releases */
+    uint32_t rtbudget;      /* CPU time it may use per period */
+    uint32_t rtreldl;       /* Deadline, relative to each release */
+    uint32_t rtrelease;     /* clkticks its current period began */
+    uint32_t rtdeadline;    /* clkticks it must be done by */
+    uint64_t rtleft;        /* TSC cycles of budget left this period */
+    uint64_t rtstamp;       /* TSC when rtleft was last charged */
+
+    /* Mailbox: ring of MBOXDEPTH messages, from getmem */
+    msg_t *mbuf;
+    uint16_t mhead;         /* Index of the oldest message */
+    uint16_t mcount;        /* Messages waiting */
+    struct pcb *sndhead;    /* Senders parked on a full mailbox, */
+    struct pcb *sndtail;    /* linked through qnext */
 
     /* Process entry point */
     void      (*entry)(void);            /* Function where process starts */
 
     /* Debugging / identification */
     char        name[PNMLEN];
-};
+} __attribute__((aligned(64)));
 
 
 /* -----------------------------
@@ -68,17 +147,47 @@ struct pcb {
  * (defined in process.c)
  * ----------------------------- */
 
-extern struct pcb proctab[NPROC];
-extern int currpid;     /* PID of currently running process */
+extern struct pcb *pcbdir[NPCBDIR];
+extern int npid;        /* PIDs below this have a PCB */
+
+/* PID of the process running on this CPU. It lives in the CPU's
+ * struct cpu (smp.h), which %fs points at; one instruction reads it,
+ * so the result is right even if the process migrates. */
+#define CPU_CURRPID  4      /* offsetof(struct cpu, runpid) */
+
+#ifndef KACCHI_HOSTED
+
+static inline int getcurrpid(void) {
+    int pid;
+    __asm__ volatile ("movl %%fs:%c1, %0" : "=r"(pid) : "i"(CPU_CURRPID));
+    return pid;
+}
+
+#define currpid  getcurrpid()
+
+#else
+/* Host builds simulate one CPU; host/schedsim.c supplies these */
+int getcurrpid(void);
+uint32_t *hostctx(int pid, void (*entry)(void *), void *arg);
+
+#define currpid  getcurrpid()
+#endif
 
 
 /* -----------------------------
  * Utility macros
  * ----------------------------- */
 
+/* PCB of a PID below npid */
+#define proctab(pid) \
+    (&pcbdir[(uint32_t)(pid) / PCBCHUNK][(uint32_t)(pid) % PCBCHUNK])
+
+/* Nonzero for a CPU's idle process (NULLPROC on the boot CPU) */
+#define isidle(pid)  (proctab(pid)->pflags & PF_IDLE)
+
 /* Check whether a PID is invalid or refers to a free entry */
 #define isbadpid(pid) \
-    ((pid) < 0 || (pid) >= NPROC || proctab[(pid)].state == PR_FREE)
+    ((pid) < 0 || (pid) >= npid || proctab(pid)->state == PR_FREE)
 
 
 /* -----------------------------
@@ -91,6 +200,14 @@ void process_init(void);
 /* Create a new process */
 int process_create(void (*entry)(void), const char *name);
 
+/* Create a process with a given stack size (0: default), priority,
+ * and argument for entry */
+int process_create_ex(void (*entry)(void *), const char *name,
+                      uint32_t stksize, int prio, void *arg);
+
+/* PCB for a CPU's idle process, which runs on its boot stack (smp.c) */
+int idle_create(int cpu, void *stack, uint32_t stksize);
+
 /* Terminate the currently running process */
 void process_exit(void);
 
@@ -106,8 +223,44 @@ int wakeup(int pid);
 int set_priority(int pid, int prio);
 int get_priority(int pid);
 
+/* Allocate from the current process's arena (freed at exit) */
+void *getpmem(uint32_t nbytes);
+
+/* Stack painting, overflow canary and high-water marks (stkwatch.c) */
+void stkpaint(int pid);
+void stkcheck(int pid);
+int stkpeak(int pid);
+void stkreport(void);
+
+/* Accounting snapshots and the "top" report (pstat.c) */
+struct pstat {
+    int pid;
+    int state;              /* PR_* */
+    char name[PNMLEN];
+    struct pcount c;        /* Includes the slice it is running now */
+};
+
+int pstatget(int pid, struct pstat *ps);
+void pstatreport(void);
+
+/* Lazy FPU/SSE switching (fpu.c) */
+#define FXSIZE  512         /* FXSAVE image; getmem blocks are aligned enough */
+
+int fputrap(void);
+void fpu_switch(int old);
+void fpu_release(int pid);
+
+/* Mailboxes (mailbox.c). Status and messages are kept apart: calls
+ * return -1 on error and hand messages back through pointers, so any
+ * msg_t value, -1 included, can be sent. */
+int mboxinit(int pid);
+void mboxfree(int pid);
 int send(int pid, msg_t msg);
-msg_t receive(void);
+int trysend(int pid, msg_t msg);
+int sendn(int pid, const msg_t *msgs, int n);
+int sendrecv(int pid, msg_t msg, msg_t *reply);
+int receive(msg_t *msg);
+int receiven(msg_t *msgs, int max);
 
 
 #endif /* PROCESS_H */
@@ -0,0 +1,141 @@
+/* pstat.c - pstatget, pstatreport */
+#include "types.h"
+#include "string.h"
+#include "memory.h"
+#include "process.h"
+#include "serial.h"
+#include "intr.h"
+#include "clock.h"
+#include "x86.h"
+
+/*
+ * The counters in each PCB's pcount are charged at state changes:
+ * swtch() charges the outgoing process its slice and the incoming one
+ * its time on the queue, ready() charges the time blocked. pstamp
+ * marks the start of whatever the process is doing now, so a snapshot
+ * adds that open interval in.
+ */
+
+/*------------------------------------------------------------------------
+* pstatget - Snapshot one process's resource use
+*------------------------------------------------------------------------
+*/
+int pstatget(
+    int pid,            /* Process to look at */
+    struct pstat *ps    /* Receives the snapshot */
+)
+{
+    intmask mask; /* Saved interrupt mask */
+    struct pcb *p;
+    uint64_t open;
+
+    mask = disable();
+    if (isbadpid(pid) || ps == NULL) {
+        restore(mask);
+        return -1;
+    }
+    p = proctab(pid);
+    ps->pid = pid;
+    ps->state = p->state;
+    memcpy(ps->name, p->name, PNMLEN);
+    ps->c = p->pcount;
+
+    open = rdtsc() - p->pstamp;
+    if (p->state == PR_CURR)
+        ps->c.cycles += open;
+    else if (p->state == PR_READY)
+        ps->c.readycyc += open;
+    else if (!isidle(pid))
+        ps->c.blockcyc += open;
+    restore(mask);
+    return 0;
+}
+
+/* Print cycles as milliseconds */
+static void putms(uint64_t cycles, uint32_t khz)
+{
+    serial_putdec((uint32_t)div64(cycles, khz));
+}
+
+/*------------------------------------------------------------------------
+* pstatreport - Print every process's resource use, biggest CPU share
+*               first. Times are in milliseconds; the share is of the
+*               CPU time all live processes have had.
+*------------------------------------------------------------------------
+*/
+void pstatreport(void)
+{
+    intmask mask; /* Saved interrupt mask */
+    struct pstat *ps, tmp;
+    uint64_t total = 0;
+    uint32_t khz = tsckhz() ? tsckhz() : 1;
+    int n = 0, max, shift = 0, j;
+
+    mask = disable();
+    for (int pid = 0; pid < npid; pid++)
+        if (proctab(pid)->state != PR_FREE)
+            n++;
+    restore(mask);
+
+    ps = (struct pstat *)getmem(n * sizeof(struct pstat));
+    if (ps == NULL) {
+        serial_puts("top: no memory\n");
+        return;
+    }
+
+    /* Processes created since the count are left out */
+    max = n;
+    n = 0;
+    for (int pid = 0; pid < npid && n < max; pid++)
+        if (pstatget(pid, &ps[n]) == 0)
+            total += ps[n++].c.cycles;
+
+    /* Shell sort, most cycles first */
+    for (int gap = n / 2; gap > 0; gap /= 2)
+        for (int i = gap; i < n; i++) {
+            tmp = ps[i];
+            for (j = i; j >= gap && ps[j - gap].c.cycles < tmp.c.cycles;
+                 j -= gap)
+                ps[j] = ps[j - gap];
+            ps[j] = tmp;
+        }
+
+    /* Scale so the total fits a 32-bit divisor */
+    while ((total >> shift) > 0xFFFFFFFFull)
+        shift++;
+
+    serial_puts("  pid\tname\tcpu%\tcpu\tready\tblock\tvol\tinvol\tsent\trecv\n");
+    for (int i = 0; i < n; i++) {
+        uint32_t share = 0;
+
+        if ((uint32_t)(total >> shift) != 0)
+            share = (uint32_t)div64((ps[i].c.cycles >> shift) * 1000,
+                                    (uint32_t)(total >> shift));
+        serial_puts("  ");
+        serial_putdec(ps[i].pid);
+        serial_puts("\t");
+        serial_puts(ps[i].name);
+        serial_puts("\t");
+        serial_putdec(share / 10);
+        serial_putc('.');
+        serial_putdec(share % 10);
+        serial_puts("\t");
+        putms(ps[i].c.cycles, khz);
+        serial_puts("\t");
+        putms(ps[i].c.readycyc, khz);
+        serial_puts("\t");
+        putms(ps[i].c.blockcyc, khz);
+        serial_puts("\t");
+        serial_putdec(ps[i].c.nvol);
+        serial_puts("\t");
+        serial_putdec(ps[i].c.ninvol);
+        serial_puts("\t");
+        serial_putdec(ps[i].c.nsent);
+        serial_puts("\t");
+        serial_putdec(ps[i].c.nrecv);
+        serial_puts("\n");
+    }
+    serial_puts("  (times in ms)\n");
+
+    freemem(ps, max * sizeof(struct pstat));
+}
@@ -1,127 +1,393 @@
-/* scheduler.c - Cooperative priority scheduler with aging */
+/* scheduler.c - Preemptive priority scheduler with aging and per-CPU
+ * queues; EDF real-time processes (edf.c) run ahead of them */
 
 #include "scheduler.h"
 #include "process.h"
 #include "serial.h"
+#include "paging.h"
+#include "x86.h"
+#include "intr.h"
+#include "clock.h"
+#include "smp.h"
+#include "trace.h"
 
 /* ---------- READY QUEUES ---------- */
-/* One FIFO queue per priority */
-static int ready_queue[MAX_PRIO][NPROC];
-static int rq_head[MAX_PRIO];
-static int rq_tail[MAX_PRIO];
+/* Each CPU has one FIFO queue per priority, linked through the PCBs
+ * (struct cpu in smp.h). All of them are guarded by the kernel lock. */
+
+/* Ticks per time slice, by priority */
+static uint32_t sched_quantum[MAX_PRIO];
 
 /* ---------- QUEUE HELPERS ---------- */
 
-static int rq_empty_prio(int pr)
+static void rq_enqueue_prio(struct cpu *c, int pid, int pr)
 {
-    return rq_head[pr] == rq_tail[pr];
+    struct pcb *p = proctab(pid);
+
+    p->qnext = NULL;
+    p->qprev = c->rq_tail[pr];
+    if (c->rq_tail[pr] != NULL)
+        c->rq_tail[pr]->qnext = p;
+    else
+        c->rq_head[pr] = p;
+    c->rq_tail[pr] = p;
+    c->rq_ready |= 1u << pr;
+    p->rq_stamp = c->epoch;
 }
 
 static void rq_enqueue(int pid)
 {
-    int pr = proctab[pid].priority;
+    struct pcb *p = proctab(pid);
+    int pr = p->priority;
 
-    if (pid == NULLPROC)
+    if (isidle(pid))
         return;
 
+    if (p->rtperiod != 0) {
+        edfinsert(&cpus[p->pcpu], p);
+        return;
+    }
+
     if (pr < 0)
         pr = 0;
     if (pr >= MAX_PRIO)
         pr = MAX_PRIO - 1;
 
-    ready_queue[pr][rq_tail[pr] % NPROC] = pid;
-    rq_tail[pr]++;
+    rq_enqueue_prio(&cpus[p->pcpu], pid, pr);
 }
 
-static int rq_dequeue_prio(int pr)
+static int rq_dequeue_prio(struct cpu *c, int pr)
 {
-    if (rq_empty_prio(pr))
+    struct pcb *p = c->rq_head[pr];
+
+    if (p == NULL)
         return -1;
 
-    int pid = ready_queue[pr][rq_head[pr] % NPROC];
-    rq_head[pr]++;
-    return pid;
+    c->rq_head[pr] = p->qnext;
+    if (c->rq_head[pr] != NULL) {
+        c->rq_head[pr]->qprev = NULL;
+    } else {
+        c->rq_tail[pr] = NULL;
+        c->rq_ready &= ~(1u << pr);
+    }
+    p->qnext = p->qprev = NULL;
+    return p->pid;
 }
 
-static int rq_dequeue_highest(void)
+static int rq_dequeue_highest(struct cpu *c)
 {
-    for (int pr = MAX_PRIO - 1; pr >= 0; pr--) {
-        if (!rq_empty_prio(pr)) {
-            int pid = ready_queue[pr][rq_head[pr] % NPROC];
-            rq_head[pr]++;
+    if (c->rq_ready == 0)
+        return -1;
+    return rq_dequeue_prio(c, bsr(c->rq_ready));
+}
+
+static int rq_top(struct cpu *c)
+{
+    return c->rq_ready ? bsr(c->rq_ready) : -1;
+}
+
+/* Highest priority queued on this CPU, or -1 */
+int rq_maxprio(void)
+{
+    return rq_top(mycpu());
+}
+
+/*------------------------------------------------------------------------
+ * rq_age - Promote every process that has waited AGING_THRESHOLD epochs.
+ *          Each FIFO is in stamp order, so the due ones are a run at its
+ *          head; the scan stops at the first that is not, and costs
+ *          MAX_PRIO plus one step per promotion, not the process count.
+ *------------------------------------------------------------------------
+ */
+static void rq_age(struct cpu *c)
+{
+    /* Queues from AGING_MAXPRIO up are not promoted from */
+    uint32_t pending = c->rq_ready & ((1u << AGING_MAXPRIO) - 1);
+
+    while (pending) {
+        int pr = bsf(pending);
+        struct pcb *p;
 
-            return pid;
+        pending &= pending - 1;
+        while ((p = c->rq_head[pr]) != NULL
+                && c->epoch - p->rq_stamp >= AGING_THRESHOLD) {
+            rq_dequeue_prio(c, pr);
+            p->priority = pr + 1;
+            rq_enqueue_prio(c, p->pid, pr + 1);
         }
     }
-    return -1;
+}
+
+/*------------------------------------------------------------------------
+ * rq_steal - Take the best process queued on another CPU if it outranks
+ *            everything queued here. Ties stay where they are, so a CPU
+ *            with work of its own keeps its cache; an idle one takes
+ *            anything.
+ *------------------------------------------------------------------------
+ */
+static int rq_steal(struct cpu *c)
+{
+    struct cpu *victim = NULL;
+    int best = rq_top(c);
+    int pid;
+
+    for (int i = 0; i < ncpu; i++) {
+        if (&cpus[i] != c && rq_top(&cpus[i]) > best) {
+            victim = &cpus[i];
+            best = rq_top(victim);
+        }
+    }
+    if (victim == NULL)
+        return -1;
+
+    pid = rq_dequeue_prio(victim, best);
+    proctab(pid)->pcpu = c->cpuid;
+    c->nsteal++;
+    return pid;
 }
 
 /* ---------- INITIALIZATION ---------- */
 
 void scheduler_init(void)
 {
-    for (int pr = 0; pr < MAX_PRIO; pr++) {
-        rq_head[pr] = rq_tail[pr] = 0;
+    for (int i = 0; i < NCPU; i++) {
+        for (int pr = 0; pr < MAX_PRIO; pr++)
+            cpus[i].rq_head[pr] = cpus[i].rq_tail[pr] = NULL;
+        cpus[i].rq_ready = 0;
+        cpus[i].epoch = 0;
+        cpus[i].fpulast = -1;
     }
 
-    /* Enqueue all processes that are READY (except NULL) */
-    for (int i = 0; i < NPROC; i++) {
-        if (i != NULLPROC && proctab[i].state == PR_READY) {
-            rq_enqueue(i);
-        }
+    /* Lower priorities get longer, rarer slices */
+    for (int pr = 0; pr < MAX_PRIO; pr++) {
+        sched_quantum[pr] = MSTOTICKS(QUANTUM_MS * (MAX_PRIO - pr));
+        if (sched_quantum[pr] == 0)
+            sched_quantum[pr] = 1;
     }
+    mycpu()->preempt = sched_quantum[NULL_PRIO];
+}
+
+/* ---------- READY ---------- */
+
+/* Make a process eligible to run on the CPU it last ran on; it must not
+ * already be queued */
+void ready(int pid)
+{
+    intmask mask = disable();
+    struct pcb *p = proctab(pid);
+    uint64_t now = rdtsc();
+
+    /* Blocked (or just created) until now; queued from now */
+    p->pcount.blockcyc += now - p->pstamp;
+    p->pstamp = now;
+    p->state = PR_READY;
+    rq_enqueue(pid);
+    trace(TR_WAKEUP, currpid, pid);
+    restore(mask);
 }
 
 /* ---------- YIELD ---------- */
 
 void yield(void)
 {
-    if (currpid != NULLPROC) {
-        proctab[currpid].state = PR_READY;
+    intmask mask = disable();
+
+    if (!isidle(currpid)) {
+        proctab(currpid)->state = PR_READY;
         rq_enqueue(currpid);
     }
 
     schedule();
 
-    /* MUST NEVER RETURN */
+    restore(mask);
 }
 
 /* ---------- CORE SCHEDULER ---------- */
 
+/* Length of a time slice at priority pr */
+static uint32_t quantum(int pr)
+{
+    if (pr < 0)
+        pr = 0;
+    if (pr >= MAX_PRIO)
+        pr = MAX_PRIO - 1;
+    return sched_quantum[pr];
+}
+
+/*------------------------------------------------------------------------
+ * swtch - Switch this CPU from old to next, with the kernel lock held
+ *------------------------------------------------------------------------
+ */
+static void swtch(struct cpu *c, int old, int next)
+{
+    struct pcb *op = proctab(old);
+    struct pcb *np = proctab(next);
+    uint64_t now = rdtsc();
+#ifdef KACCHI_SMP
+    uint32_t knest;
+#endif
+
+    /* Only an idle process, which is never queued, is still current */
+    if (op->state == PR_CURR)
+        op->state = PR_READY;
+
+    /* Charge old its slice, next its wait in the queue */
+    op->pcount.cycles += now - op->pstamp;
+    op->pstamp = now;
+    if (op->rtperiod != 0)
+        edfcharge(op, now);
+    if (op->pflags & PF_PREEMPT)
+        op->pcount.ninvol++;
+    else
+        op->pcount.nvol++;
+    op->pflags &= ~PF_PREEMPT;
+    if (!isidle(next))
+        np->pcount.readycyc += now - np->pstamp;
+    np->pstamp = now;
+    np->rtstamp = now;
+
+    c->runpid = next;
+    c->nswitch++;
+    fpu_switch(old);
+    stkcheck(old);
+    trace(TR_SWITCH, old, next | (uint32_t)proctab(old)->state << 16);
+
+#ifdef KACCHI_SMP
+    /* The kernel lock passes to next with this CPU. When this process
+     * runs again, possibly on another CPU, it takes its own nesting
+     * depth back. */
+    knest = c->knest;
+    ctx_switch(&proctab(old)->sp, proctab(next)->sp);
+    mycpu()->knest = knest;
+#else
+    ctx_switch(&proctab(old)->sp, proctab(next)->sp);
+#endif
+}
+
+/*------------------------------------------------------------------------
+ * klockdrop - Drop the kernel lock a new process inherits from
+ *             schedule(); proc_start calls it before the entry point.
+ *             Only kernel-smp.elf has the lock to drop.
+ *------------------------------------------------------------------------
+ */
+void klockdrop(void)
+{
+#ifdef KACCHI_SMP
+    mycpu()->knest = 0;
+    spin_unlock(&kernlock);
+#endif
+}
+
 void schedule(void)
 {
+    /* The saved mask lives on the old stack until it runs again */
+    intmask mask = disable();
+    struct cpu *c = mycpu();
+
     /* ---------- AGING ---------- */
-    for (int i = 0; i < NPROC; i++) {
-        if (proctab[i].state == PR_READY) {
-            proctab[i].wait_ticks++;
-
-            if (proctab[i].wait_ticks >= AGING_THRESHOLD) {
-                if (proctab[i].priority < MAX_PRIO - 1)
-                    proctab[i].priority++;
-                proctab[i].wait_ticks = 0;
-            }
-        }
-    }
+    c->epoch++;
+    rq_age(c);
 
     int old = currpid;
 
+    trace(TR_SCHED, old, c->rq_ready);
+
+    /* Keep frames ready for stack faults in the next time slice, and
+     * drop translations another CPU unmapped */
+    vmrefill();
+    vmtlbsync();
+
     /* ---------- PICK NEXT PROCESS ---------- */
-    int next = rq_dequeue_highest();
+    /* EDF processes first: they are never stolen, and never wait for
+     * best-effort work */
+    int next = edfpop(c);
 
+    if (next < 0)
+        next = rq_steal(c);
+    if (next < 0)
+        next = rq_dequeue_highest(c);
     if (next < 0) {
-        /* No runnable process → stay in current */
-        return;
+        /* No runnable process: stay in current if it can still run,
+         * otherwise (it exited or blocked) fall back to this CPU's
+         * idle process */
+        if (proctab(old)->state == PR_CURR || proctab(old)->state == PR_READY)
+            next = old;
+        else
+            next = c->idlepid;
     }
 
+    proctab(next)->state = PR_CURR;
+    c->preempt = quantum(proctab(next)->priority);
+
     /* Don't context switch if same process */
     if (next == old) {
+        proctab(old)->pflags &= ~PF_PREEMPT;
+        restore(mask);
         return;
     }
 
     /* ---------- SWITCH ---------- */
-    proctab[next].state = PR_CURR;
-    proctab[next].wait_ticks = 0;
-    currpid = next;
+    swtch(c, old, next);
+
+    restore(mask);
+}
+
+/*------------------------------------------------------------------------
+ * handoff - Make pid, which the caller just gave a reason to run, the
+ *           running process at once: no pass over the ready queues, no
+ *           aging, and pid runs out the caller's time slice. The caller
+ *           sets its own state first. If it is still PR_CURR it is
+ *           queued behind its peers; otherwise it is blocking, and
+ *           resumes when something readies it. pid is only readied when
+ *           a queued process, or a still-runnable caller, outranks it.
+ *------------------------------------------------------------------------
+ */
+void handoff(
+    int pid /* Process blocked in receive() or similar; not queued */
+)
+{
+    intmask mask = disable();
+    struct cpu *c = mycpu();
+    int old = currpid;
+    struct pcb *p = proctab(pid);
+    int running = (proctab(old)->state == PR_CURR);
+    uint64_t now;
+
+    /* EDF processes go by deadline, on their own CPU: pid waits its
+     * turn on its heap unless it is due before a running caller */
+    if (p->rtperiod != 0 || proctab(old)->rtperiod != 0) {
+        ready(pid);
+        if (!running)
+            schedule();
+        else if (p->rtperiod != 0 && p->pcpu == c->cpuid
+                 && (proctab(old)->rtperiod == 0
+                     || dlbefore(p, proctab(old))))
+            yield();
+        restore(mask);
+        return;
+    }
+
+    if (p->priority < rq_top(c)
+            || (running && p->priority < proctab(old)->priority)) {
+        ready(pid);
+        if (!running)
+            schedule();
+        restore(mask);
+        return;
+    }
+
+    if (running && !isidle(old)) {
+        proctab(old)->state = PR_READY;
+        rq_enqueue(old);
+    }
+    p->state = PR_CURR;
+    p->pcpu = c->cpuid;
+    now = rdtsc();
+    p->pcount.blockcyc += now - p->pstamp;
+    p->pstamp = now;
+    trace(TR_WAKEUP, old, pid);
+    vmtlbsync();
+    swtch(c, old, pid);
 
-    ctx_switch(&proctab[old].sp, proctab[next].sp);
+    restore(mask);
 }
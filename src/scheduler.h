@@ -1,22 +1,69 @@
-/* scheduler.h - Cooperative scheduler interface */
+/* scheduler.h - Priority scheduler interface */
 
 #ifndef SCHEDULER_H
 #define SCHEDULER_H
 
 #include "process.h"
 
-#define AGING_THRESHOLD 100  /* High threshold to avoid premature promotion in short-running systems */
-#define MAX_PRIO 8
+#define AGING_THRESHOLD 100  /* schedule() calls a READY process waits before promotion */
+/* Aging promotes no higher than this; MAX_PRIO - 1 is left to the
+ * processes set there, such as the shell */
+#define AGING_MAXPRIO   (MAX_PRIO - 2)
+/* Time slice at the top priority; priority pr gets
+ * QUANTUM_MS * (MAX_PRIO - pr). Override with make CFLAGS+=-DQUANTUM_MS=... */
+#ifndef QUANTUM_MS
+#define QUANTUM_MS  10
+#endif
+
+/* Real-time utilization each CPU may admit, in 1/1000; the rest is
+ * left for best-effort work. Override with make CFLAGS+=-DRT_UTILMAX=... */
+#ifndef RT_UTILMAX
+#define RT_UTILMAX  900
+#endif
 
-/* Initialize scheduler */
+/* Initialize scheduler; call before creating processes */
 void scheduler_init(void);
 
+/* Put a process on its ready queue */
+void ready(int pid);
+
+/* Highest priority with a ready process, or -1 */
+int rq_maxprio(void);
+
 /* Yield CPU voluntarily */
 void yield(void);
 
-/* Run scheduler */
+/* Run scheduler; safe to call with interrupts on or off */
 void schedule(void);
+
+/* Switch straight to a process that was waiting for the caller */
+void handoff(int pid);
 void ctx_switch(uint32_t **old_sp, uint32_t *new_sp);
 
+/* Real-time class (edf.c). The caller becomes an EDF process that may
+ * run budget_ms in every period_ms, finishing each within deadline_ms
+ * (0: the period) of its release; -1 if no CPU can admit it */
+int rt_set(uint32_t period_ms, uint32_t budget_ms, uint32_t deadline_ms);
+
+/* Return the caller to best effort at its priority */
+int rt_clear(void);
+
+/* End this period's work: sleep until the next release */
+int rt_wait(void);
+
+/* EDF process a is due before b; clkticks wraps */
+#define dlbefore(a, b)  ((int32_t)((a)->rtdeadline - (b)->rtdeadline) < 0)
+
+/* Scheduler hooks: queue, take the earliest deadline, charge the
+ * budget, and the tick */
+struct cpu;
+void edfinsert(struct cpu *c, struct pcb *p);
+int edfpop(struct cpu *c);
+void edfcharge(struct pcb *p, uint64_t now);
+int edftick(void);
+
+/* Where a new process's stack first returns to (context_switch.S) */
+void proc_start(void);
+
 
 #endif
@@ -1,9 +1,16 @@
 /* serial.c - Serial port driver (COM1) */
 #include "serial.h"
 #include "io.h"
+#include "intr.h"
+#include "sync.h"
+#include "process.h"
+#include "x86.h"
 
 #define COM1 0x3F8   /* I/O port base address for COM1 */
 
+/* Received bytes not yet read; a power of two */
+#define RXBUFSIZE 256
+
 /*
 You can find more information here: https://caro.su/msx/ocm_de1/16550.pdf
 
@@ -15,7 +22,9 @@ QEMU (-serial stdio)
     ↓
 Emulated COM1 port (0x3F8)
     ↓
-serial_getc() reads from COM1
+serial_rxirq() moves it from COM1 into rxbuf
+    ↓
+serial_getc() takes it from there
     ↓
 Your OS receives the character
 
@@ -36,34 +45,136 @@ static int is_transmit_empty(void) {
     return inb(COM1 + 5) & 0x20;
 }
 
-void serial_putc(char c) {
+/*
+ * Console lock: one process at a time writes to COM1, so a line, or a
+ * whole trace frame (trdump), goes out in one piece even with other
+ * processes and CPUs printing. Boot code, IRQ handlers and idle
+ * processes cannot wait and write unlocked; the holder's own nested
+ * calls go straight through.
+ */
+static struct mutex conlock;
+static int conlockon;       /* Set once processes can wait on conlock */
+static int condepth;        /* Holder's serial_lock nesting */
+
+/* Hold COM1 until the matching serial_unlock */
+void serial_lock(void) {
+    if (!conlockon)
+        return;
+    if (conlock.mowner == currpid) {
+        condepth++;
+        return;
+    }
+    if (!(read_eflags() & EFLAGS_IF) || isidle(currpid))
+        return;
+    mutex_lock(&conlock);
+    condepth = 1;
+}
+
+void serial_unlock(void) {
+    if (conlockon && conlock.mowner == currpid && --condepth == 0)
+        mutex_unlock(&conlock);
+}
+
+static void conputc(char c) {
     if (c == '\n') {
-        serial_putc('\r');  /* Add carriage return */
+        conputc('\r');  /* Add carriage return */
     }
     while (!is_transmit_empty());
     outb(COM1, c);
 }
 
+void serial_putc(char c) {
+    serial_lock();
+    conputc(c);
+    serial_unlock();
+}
+
 void serial_puts(const char* str) {
+    serial_lock();
     while (*str) {
-        serial_putc(*str++);
+        conputc(*str++);
     }
+    serial_unlock();
 }
 
 /* Print a 32-bit value in hexadecimal (0xABCD1234) */
 void serial_puthex32(uint32_t val) {
     const char* hex = "0123456789ABCDEF";
+    serial_lock();
     serial_puts("0x");
     for (int i = 28; i >= 0; i -= 4) {
-        serial_putc(hex[(val >> i) & 0xF]);
+        conputc(hex[(val >> i) & 0xF]);
     }
+    serial_unlock();
+}
+
+/* Print an unsigned 32-bit value in decimal */
+void serial_putdec(uint32_t val) {
+    char buf[10];
+    int i = 0;
+    do {
+        buf[i++] = '0' + (val % 10);
+        val /= 10;
+    } while (val != 0);
+    serial_lock();
+    while (i > 0) {
+        conputc(buf[--i]);
+    }
+    serial_unlock();
+}
+
+/* Send n bytes as they are: no carriage returns added */
+void serial_write(const void *buf, uint32_t n) {
+    const uint8_t *p = buf;
+    serial_lock();
+    while (n-- > 0) {
+        while (!is_transmit_empty());
+        outb(COM1, *p++);
+    }
+    serial_unlock();
 }
 
 static int serial_received(void) {
     return inb(COM1 + 5) & 0x01;
 }
 
+/* Filled by serial_rxirq, emptied by serial_getc */
+static uint8_t rxbuf[RXBUFSIZE];
+static uint32_t rxhead, rxtail;     /* Next to read, next to fill */
+static struct sem rxsem;            /* One unit per byte in rxbuf */
+
+/* IRQ_COM1: move everything the UART holds into rxbuf. A reader it
+ * wakes runs when the tick next finds it outranks the current process,
+ * at once if the CPU was idle. */
+static void serial_rxirq(void) {
+    while (serial_received()) {
+        uint8_t c = inb(COM1);
+
+        if (rxtail - rxhead == RXBUFSIZE)
+            continue;   /* Nobody is reading: drop it */
+        rxbuf[rxtail++ % RXBUFSIZE] = c;
+        sem_signal(&rxsem);
+    }
+}
+
+/* Take input on IRQ_COM1, and make writers take the console lock,
+ * from here on; needs the scheduler */
+void serial_rxinit(void) {
+    mutex_init(&conlock);
+    conlockon = 1;
+    sem_init(&rxsem, 0);
+    set_irq_handler(IRQ_COM1, serial_rxirq);
+    outb(COM1 + 1, 0x01);    /* Interrupt when data arrives */
+}
+
+/* The next received byte, waiting for one if none has come */
 char serial_getc(void) {
-    while (!serial_received());
-    return inb(COM1);
+    intmask mask; /* Saved interrupt mask */
+    char c;
+
+    sem_wait(&rxsem);
+    mask = disable();
+    c = rxbuf[rxhead++ % RXBUFSIZE];
+    restore(mask);
+    return c;
 }
@@ -8,6 +8,11 @@ void serial_init(void);
 void serial_putc(char c);
 void serial_puts(const char* str);
 void serial_puthex32(uint32_t val);
+void serial_putdec(uint32_t val);
+void serial_write(const void *buf, uint32_t n);
+void serial_lock(void);
+void serial_unlock(void);
+void serial_rxinit(void);
 char serial_getc(void);
 
 #endif
\ No newline at end of file
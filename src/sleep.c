@@ -0,0 +1,68 @@
+/* sleep.c - sleep_ticks, sleep_ms, unsleep */
+#include "types.h"
+#include "intr.h"
+#include "clock.h"
+#include "process.h"
+#include "scheduler.h"
+
+/*------------------------------------------------------------------------
+* sleep_ticks - Leave the ready queues for the given number of ticks
+*------------------------------------------------------------------------
+*/
+int sleep_ticks(
+    uint32_t ticks /* Ticks to sleep; 0 just yields */
+)
+{
+    intmask mask; /* Saved interrupt mask */
+
+    if (isidle(currpid))
+        return -1; /* An idle process must stay runnable */
+
+    mask = disable();
+    if (ticks == 0) {
+        yield();
+        restore(mask);
+        return 0;
+    }
+
+    proctab(currpid)->state = PR_SLEEP;
+    twinsert(currpid, clkticks + ticks);
+    schedule();
+
+    restore(mask);
+    return 0;
+}
+
+/*------------------------------------------------------------------------
+* sleep_ms - Sleep for at least ms milliseconds
+*------------------------------------------------------------------------
+*/
+int sleep_ms(
+    uint32_t ms /* Milliseconds to sleep */
+)
+{
+    /* Split so ms * CLKHZ cannot overflow */
+    return sleep_ticks((ms / 1000) * CLKHZ + MSTOTICKS(ms % 1000));
+}
+
+/*------------------------------------------------------------------------
+* unsleep - Wake a sleeping process early
+*------------------------------------------------------------------------
+*/
+int unsleep(
+    int pid /* Process in PR_SLEEP */
+)
+{
+    intmask mask; /* Saved interrupt mask */
+
+    mask = disable();
+    if (isbadpid(pid) || proctab(pid)->state != PR_SLEEP) {
+        restore(mask);
+        return -1;
+    }
+
+    twremove(pid);
+    ready(pid);
+    restore(mask);
+    return 0;
+}
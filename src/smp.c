@@ -0,0 +1,362 @@
+/* smp.c - smp_init, ap_main, kernel lock, local APIC and IPIs; linked
+ * into kernel-smp.elf only, where everything is built with KACCHI_SMP */
+#include "types.h"
+#include "io.h"
+#include "x86.h"
+#include "serial.h"
+#include "string.h"
+#include "memory.h"
+#include "paging.h"
+#include "process.h"
+#include "scheduler.h"
+#include "clock.h"
+#include "intr.h"
+#include "smp.h"
+
+/* Local APIC registers, as indexes into the 32-bit register array */
+#define LAPIC_ID        (0x020 / 4)
+#define LAPIC_TPR       (0x080 / 4)
+#define LAPIC_EOI       (0x0B0 / 4)
+#define LAPIC_SVR       (0x0F0 / 4)
+#define LAPIC_ICRLO     (0x300 / 4)
+#define LAPIC_ICRHI     (0x310 / 4)
+
+#define SVR_ENABLE      0x00000100  /* APIC software enable */
+#define ICR_INIT        0x00000500
+#define ICR_STARTUP     0x00000600
+#define ICR_PENDING     0x00001000  /* Delivery status: not yet sent */
+#define ICR_ASSERT      0x00004000
+#define ICR_LEVEL       0x00008000
+#define ICR_OTHERS      0x000C0000  /* Shorthand: all but self */
+
+/* BIOS data area and CMOS warm-reset vector */
+#define BDA_EBDA        0x40E       /* Segment of the extended BDA */
+#define BDA_BASEKB      0x413       /* KB of base memory */
+#define WARMRESET       0x467       /* Offset, then segment, to jump to */
+#define CMOS_PORT       0x70
+#define CMOS_SHUTDOWN   0x0F        /* Shutdown status byte */
+
+struct spinlock kernlock;
+
+static volatile uint32_t *lapic;
+
+/* -----------------------------
+ * Intel MP tables (MP spec 1.4)
+ * ----------------------------- */
+
+struct mpfloat {
+    char signature[4];      /* "_MP_" */
+    uint32_t physaddr;      /* Configuration table, or 0 */
+    uint8_t length;         /* In 16-byte units: 1 */
+    uint8_t specrev;
+    uint8_t checksum;       /* All bytes sum to 0 */
+    uint8_t type;           /* Nonzero: a default configuration */
+    uint8_t imcrp;
+    uint8_t reserved[3];
+} __attribute__((packed));
+
+struct mpconf {
+    char signature[4];      /* "PCMP" */
+    uint16_t length;        /* Base table length */
+    uint8_t version;        /* 1 or 4 */
+    uint8_t checksum;
+    char oemid[20];         /* OEM and product IDs */
+    uint32_t oemtable;
+    uint16_t oemlength;
+    uint16_t nentry;        /* Entries following the header */
+    uint32_t lapicaddr;     /* Local APIC base */
+    uint16_t xlength;
+    uint8_t xchecksum;
+    uint8_t reserved;
+} __attribute__((packed));
+
+struct mpproc {
+    uint8_t type;           /* MPPROC */
+    uint8_t apicid;
+    uint8_t version;
+    uint8_t flags;          /* MPP_* */
+    uint8_t signature[4];
+    uint32_t feature;
+    uint8_t reserved[8];
+} __attribute__((packed));
+
+#define MPPROC          0   /* Processor entries are 20 bytes, */
+#define MPOTHER         8   /* the other kinds 8 */
+#define MPP_ENABLED     0x01
+#define MPP_BSP         0x02
+
+extern char apboot_start[], apboot_end[];
+extern char apcr0[], apcr3[], apcr4[], apstack[], apcpu[];
+
+/* Word of the copied trampoline that holds sym */
+#define APVAR(sym)  (*(uint32_t *)(APBOOT + ((sym) - apboot_start)))
+
+/* A pointer to a fixed word in low memory. GCC takes constant
+ * addresses this low for offsets from NULL and warns on every access. */
+static volatile uint16_t *lowmem16(uint32_t pa)
+{
+    __asm__ ("" : "+r"(pa));
+    return (volatile uint16_t *)pa;
+}
+
+static uint8_t sum(const void *addr, uint32_t len)
+{
+    const uint8_t *p = addr;
+    uint8_t s = 0;
+
+    while (len--)
+        s += *p++;
+    return s;
+}
+
+/* Look for the floating pointer in [addr, addr+len) */
+static struct mpfloat *mpsearch1(uint32_t addr, uint32_t len)
+{
+    for (uint32_t p = addr; p + sizeof(struct mpfloat) <= addr + len;
+         p += 16) {
+        if (memcmp((void *)p, "_MP_", 4) == 0
+                && sum((void *)p, sizeof(struct mpfloat)) == 0)
+            return (struct mpfloat *)p;
+    }
+    return NULL;
+}
+
+/* The spec's search order: EBDA, top of base memory, BIOS ROM */
+static struct mpfloat *mpsearch(void)
+{
+    struct mpfloat *mp;
+    uint32_t p;
+
+    p = (uint32_t)*lowmem16(BDA_EBDA) << 4;
+    if (p != 0 && (mp = mpsearch1(p, 1024)) != NULL)
+        return mp;
+    p = (uint32_t)*lowmem16(BDA_BASEKB) * 1024;
+    if (p >= 1024 && (mp = mpsearch1(p - 1024, 1024)) != NULL)
+        return mp;
+    return mpsearch1(0xF0000, 0x10000);
+}
+
+static struct mpconf *mpconfig(void)
+{
+    struct mpfloat *mp = mpsearch();
+    struct mpconf *conf;
+
+    if (mp == NULL || mp->physaddr == 0)
+        return NULL;
+    conf = (struct mpconf *)mp->physaddr;
+    if (memcmp(conf->signature, "PCMP", 4) != 0
+            || (conf->version != 1 && conf->version != 4)
+            || sum(conf, conf->length) != 0)
+        return NULL;
+    return conf;
+}
+
+/* -----------------------------
+ * Kernel lock
+ * -----------------------------
+ * One lock for the whole kernel, taken by the outermost disable() on
+ * a CPU. Everything that used to be safe with interrupts off stays
+ * safe across CPUs, and only processes in the kernel contend for it.
+ */
+
+void klock(void)
+{
+    struct cpu *c = mycpu();
+
+    if (c->knest++ == 0)
+        spin_lock(&kernlock);
+}
+
+void kunlock(void)
+{
+    struct cpu *c = mycpu();
+
+    if (--c->knest == 0)
+        spin_unlock(&kernlock);
+}
+
+/* -----------------------------
+ * Local APIC
+ * ----------------------------- */
+
+static void lapic_init(void)
+{
+    lapic[LAPIC_SVR] = SVR_ENABLE | IPI_SPURIOUS;
+    lapic[LAPIC_TPR] = 0;
+}
+
+void lapic_eoi(void)
+{
+    lapic[LAPIC_EOI] = 0;
+}
+
+static void icrwait(void)
+{
+    while (lapic[LAPIC_ICRLO] & ICR_PENDING)
+        __asm__ volatile ("pause");
+}
+
+/*------------------------------------------------------------------------
+* ipi_send - Send an interprocessor interrupt to one local APIC
+*------------------------------------------------------------------------
+*/
+void ipi_send(
+    int apicid,         /* Destination */
+    uint32_t icrlo      /* Delivery mode, level and vector */
+)
+{
+    intmask mask; /* Saved interrupt mask */
+
+    /* The tick handler must not send between the two writes */
+    mask = disable();
+    lapic[LAPIC_ICRHI] = (uint32_t)apicid << 24;
+    lapic[LAPIC_ICRLO] = icrlo;
+    icrwait();
+    restore(mask);
+}
+
+/* Send vector to every CPU but this one */
+void ipi_broadcast(int vector)
+{
+    lapic[LAPIC_ICRLO] = ICR_OTHERS | ICR_ASSERT | (uint32_t)vector;
+    icrwait();
+}
+
+/* Busy-wait for at least n ticks; needs the tick running */
+static void tickwait(uint32_t n)
+{
+    volatile uint32_t *ticks = &clkticks;
+    uint32_t start = *ticks;
+
+    while (*ticks - start <= n)
+        __asm__ volatile ("pause");
+}
+
+/*------------------------------------------------------------------------
+* startap - INIT-SIPI-SIPI one application processor and wait for it
+*------------------------------------------------------------------------
+*/
+static int startap(
+    int cpu,            /* Index in cpus[] it gets */
+    int apicid          /* Its local APIC ID */
+)
+{
+    struct cpu *c = &cpus[cpu];
+    volatile uint16_t *warm = lowmem16(WARMRESET);
+    void *stack;
+    int pid;
+
+    stack = getstk(APSTKSIZE);
+    if (stack == NULL)
+        return -1;
+    pid = idle_create(cpu, stack, APSTKSIZE);
+    if (pid < 0) {
+        freestk(stack, APSTKSIZE);
+        return -1;
+    }
+    c->apicid = apicid;
+    c->idlepid = pid;
+    c->runpid = pid;
+    c->started = 0;
+
+    APVAR(apcr0) = read_cr0();
+    APVAR(apcr3) = read_cr3();
+    APVAR(apcr4) = read_cr4();
+    APVAR(apstack) = (uint32_t)stack & ~0xF;
+    APVAR(apcpu) = cpu;
+
+    /* Older CPUs take INIT as a reset and go through the BIOS, which
+     * jumps to the warm-reset vector when the shutdown code says so */
+    outb(CMOS_PORT, CMOS_SHUTDOWN);
+    outb(CMOS_PORT + 1, 0x0A);
+    warm[0] = 0;
+    warm[1] = APBOOT >> 4;
+
+    ipi_send(apicid, ICR_INIT | ICR_LEVEL | ICR_ASSERT);
+    tickwait(MSTOTICKS(10));
+    ipi_send(apicid, ICR_INIT | ICR_LEVEL);
+    for (int i = 0; i < 2; i++) {
+        ipi_send(apicid, ICR_STARTUP | (APBOOT >> 12));
+        tickwait(1);
+    }
+
+    for (uint32_t t = 0; t < MSTOTICKS(100) && !c->started; t++)
+        tickwait(1);
+    return c->started ? 0 : -1;
+}
+
+/*------------------------------------------------------------------------
+* smp_init - Find the other CPUs in the MP table and start them. Call
+*            with the tick running and interrupts enabled; processes
+*            created afterwards are spread by work stealing.
+*------------------------------------------------------------------------
+*/
+void smp_init(void)
+{
+    struct mpconf *conf;
+    uint8_t *p, *end;
+
+    conf = mpconfig();
+    if (conf == NULL) {
+        serial_puts("smp: no MP table, 1 CPU\n");
+        return;
+    }
+
+    vmmapio(conf->lapicaddr);
+    lapic = (volatile uint32_t *)conf->lapicaddr;
+    lapic_init();
+    cpus[0].apicid = lapic[LAPIC_ID] >> 24;
+
+    memcpy((void *)APBOOT, apboot_start, apboot_end - apboot_start);
+
+    p = (uint8_t *)(conf + 1);
+    end = (uint8_t *)conf + conf->length;
+    for (int i = 0; i < conf->nentry && p < end; i++) {
+        struct mpproc *proc = (struct mpproc *)p;
+
+        if (*p != MPPROC) {
+            p += MPOTHER;
+            continue;
+        }
+        p += sizeof(struct mpproc);
+        if (!(proc->flags & MPP_ENABLED) || (proc->flags & MPP_BSP))
+            continue;
+        if (ncpu == NCPU) {
+            serial_puts("smp: more CPUs than NCPU, rest left off\n");
+            break;
+        }
+        if (startap(ncpu, proc->apicid) != 0) {
+            /* It may still wake up on that stack: never reuse the slot */
+            serial_puts("smp: CPU with APIC ID ");
+            serial_putdec(proc->apicid);
+            serial_puts(" did not start\n");
+            break;
+        }
+        ncpu++;
+    }
+
+    serial_puts("smp: ");
+    serial_putdec(ncpu);
+    serial_puts(" CPU(s) running\n");
+}
+
+/*------------------------------------------------------------------------
+* ap_main - An application processor's first C code, on its boot stack
+*           and as its idle process: load its tables, then idle
+*------------------------------------------------------------------------
+*/
+void ap_main(
+    int cpu /* Index in cpus[] */
+)
+{
+    gdt_initcpu(cpu);
+    idt_initcpu(cpu);
+    lapic_init();
+    cpus[cpu].started = 1;
+
+    enable();
+    for (;;) {
+        yield();
+        __asm__ volatile ("hlt");
+    }
+}
@@ -0,0 +1,128 @@
+/* smp.h - Per-CPU state, spinlocks, local APIC and IPIs */
+#ifndef SMP_H
+#define SMP_H
+
+#include "types.h"
+#include "x86.h"
+#include "process.h"
+
+#define NCPU        8       /* Most CPUs brought up */
+
+/* -----------------------------
+ * Spinlock
+ * ----------------------------- */
+
+struct spinlock {
+    volatile uint32_t locked;
+};
+
+static inline void spin_lock(struct spinlock *l) {
+    uint32_t v = 1;
+
+    for (;;) {
+        __asm__ volatile ("xchgl %0, %1" : "+r"(v), "+m"(l->locked)
+                          : : "memory");
+        if (v == 0)
+            return;
+        while (l->locked)
+            __asm__ volatile ("pause");
+        v = 1;
+    }
+}
+
+static inline void spin_unlock(struct spinlock *l) {
+    __asm__ volatile ("" : : : "memory");
+    l->locked = 0;
+}
+
+/* -----------------------------
+ * Per-CPU state
+ * -----------------------------
+ * %fs of each CPU is a segment based at its struct cpu, so
+ * %fs:0 is mycpu() and %fs:CPU_CURRPID is currpid (process.h).
+ * Each CPU has its own ready queues; schedule() steals from the
+ * others when they hold higher-priority work.
+ */
+struct cpu {
+    struct cpu *self;               /* %fs:0 */
+    int runpid;                     /* %fs:CPU_CURRPID: currpid */
+    int cpuid;                      /* Index in cpus[] */
+    int apicid;                     /* Local APIC ID */
+    int idlepid;                    /* Runs when nothing else can */
+    uint32_t knest;                 /* disable() depth holding kernlock */
+    uint32_t preempt;               /* Ticks left in the time slice */
+    uint32_t epoch;                 /* schedule() calls, for aging */
+    uint32_t tlbgen;                /* vmtlbgen at the last TLB flush */
+    int fpulast;                    /* PID whose state the FPU holds, or -1 */
+    volatile int started;           /* Set by the AP once it is up */
+
+    /* Ready queues, one FIFO per priority, linked through PCBs */
+    struct pcb *rq_head[MAX_PRIO];
+    struct pcb *rq_tail[MAX_PRIO];
+    uint32_t rq_ready;              /* Bit pr set if queue pr non-empty */
+
+    /* Real-time class (edf.c): ready EDF processes in a min-heap on
+     * deadline, checked before the priority queues, and those waiting
+     * for their next period. EDF processes stay on the CPU that
+     * admitted them. */
+    struct pcb *edfheap[NRTPROC];
+    int nedf;                       /* Processes in edfheap */
+    int nrt;                        /* Admitted here */
+    uint32_t rtutil;                /* Their utilization, in 1/1000 */
+    struct pcb *rtwait;             /* PR_RTWAIT, linked through qnext */
+
+    /* Statistics */
+    uint32_t nswitch;               /* Context switches */
+    uint32_t nsteal;                /* Processes taken from other CPUs */
+
+    struct tss tss;                 /* TR: saves the process on a fault */
+    struct tss pftss;               /* Runs pftask() */
+    uint8_t pfstack[4096] __attribute__((aligned(16)));
+};
+
+extern struct cpu cpus[NCPU];
+extern int ncpu;                    /* CPUs running */
+
+#ifdef KACCHI_HOSTED
+/* Host builds (host/schedsim.c) simulate cpus[0] alone */
+static inline struct cpu *mycpu(void) {
+    return &cpus[0];
+}
+#else
+static inline struct cpu *mycpu(void) {
+    struct cpu *c;
+    __asm__ volatile ("movl %%fs:0, %0" : "=r"(c));
+    return c;
+}
+#endif
+
+#ifdef KACCHI_SMP
+/* Kernel lock taken by the outermost disable() on each CPU (intr.h) */
+extern struct spinlock kernlock;
+#endif
+
+/* Drop the lock a new process inherits from schedule() (proc_start) */
+void klockdrop(void);
+
+/* -----------------------------
+ * Local APIC and IPIs
+ * ----------------------------- */
+
+#define LAPIC_DEFAULT   0xFEE00000
+
+#define IPI_TICK        0xF0    /* Broadcast by the BSP on every PIT tick */
+#define IPI_SPURIOUS    0xFF    /* LAPIC spurious vector */
+
+#define APBOOT          0x8000  /* Real-mode trampoline (apboot.S) copied here */
+#define APSTKSIZE       4096    /* Boot stack, then idle stack, of an AP */
+
+/* smp.c, in kernel-smp.elf only */
+void smp_init(void);
+void ap_main(int cpu);
+void lapic_eoi(void);
+void ipi_send(int apicid, uint32_t icrlo);
+void ipi_broadcast(int vector);
+
+void smp_report(void);
+
+#endif
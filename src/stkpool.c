@@ -0,0 +1,93 @@
+/* stkpool.c - pstkinit, getpstk, freepstk */
+#include "types.h"
+#include "memory.h"
+#include "intr.h"
+#include "paging.h"
+
+void *minpstk;
+void *maxpstk;
+
+static void *pstkfree;      /* Top word of the most recently freed slot */
+static uint32_t pstknslots; /* Slots in the pool */
+static uint32_t pstkused;   /* Slots handed out at least once */
+
+/*------------------------------------------------------------------------
+* pstkinit - Set up a pool of nslots stack slots starting at base
+*------------------------------------------------------------------------
+*/
+void pstkinit(
+    void *base, /* Lowest address of the slot area */
+    uint32_t nslots /* Number of POOLSTKSIZE slots */
+)
+{
+    minpstk = base;
+    maxpstk = (void *)((uintptr_t)base + nslots * POOLSTKSIZE);
+    pstkfree = NULL;
+    pstknslots = nslots;
+    pstkused = 0;
+}
+
+/*------------------------------------------------------------------------
+* getpstk - Pop a pooled stack, returning highest word address
+*------------------------------------------------------------------------
+*/
+void *getpstk(void)
+{
+    intmask mask; /* Saved interrupt mask */
+    void *top;
+    int fresh = 0;
+    mask = disable();
+    if (pstkfree != NULL)   /* Reuse a freed slot */
+    {
+        top = pstkfree;
+        pstkfree = *(void **)top;
+    }
+    else if (pstkused < pstknslots)   /* Take a fresh one */
+    {
+        top = (void *)((uintptr_t)minpstk + (pstkused + 1) * POOLSTKSIZE
+                       - sizeof(uint32_t));
+        pstkused++;
+        fresh = 1;
+    }
+    else     /* Pool exhausted */
+    {
+        restore(mask);
+        return NULL;
+    }
+
+    /* Drop pages the last owner grew into; back the top page */
+    if (vmstkreset(top) != 0)   /* Only a fresh slot can fail */
+    {
+        if (fresh)
+            pstkused--;
+        restore(mask);
+        return NULL;
+    }
+    restore(mask);
+    return top;
+}
+
+/*------------------------------------------------------------------------
+* freepstk - Push a pooled stack back, given its highest word address
+*------------------------------------------------------------------------
+*/
+int freepstk(
+    void *stktop /* Address returned by getpstk */
+)
+{
+    intmask mask; /* Saved interrupt mask */
+    mask = disable();
+    if (((uintptr_t)stktop < (uintptr_t)minpstk)
+            || ((uintptr_t)stktop >= (uintptr_t)maxpstk))
+    {
+        restore(mask);
+        return -1; /* Not a pool stack */
+    }
+    /* The top page stays mapped, so the link can live there. Its pages
+     * are released on reuse, since the caller may still be running on
+     * this stack (process_exit). */
+    *(void **)stktop = pstkfree;
+    pstkfree = stktop;
+    restore(mask);
+    return 0;
+}
@@ -0,0 +1,141 @@
+/* stkwatch.c - stkpaint, stkcheck, stkpeak, stkreport */
+#include "types.h"
+#include "string.h"
+#include "memory.h"
+#include "paging.h"
+#include "process.h"
+#include "serial.h"
+#include "intr.h"
+
+/*
+ * A new stack is filled with STKPAINT, and pooled stack pages faulted
+ * in later arrive painted (vmrefill), so the lowest word that no
+ * longer holds the paint is as deep as the process has ever been.
+ * The word at the stack's limit doubles as the canary: schedule()
+ * checks it each time a process is switched out.
+ */
+
+/* Lowest word of p's stack: the limit it asked for */
+static uint32_t *stklow(struct pcb *p)
+{
+    return (uint32_t *)((uintptr_t)p->stack_base + sizeof(uint32_t)
+                        - p->stack_size);
+}
+
+/*------------------------------------------------------------------------
+* stkpaint - Paint the mapped part of a new process's stack
+*------------------------------------------------------------------------
+*/
+void stkpaint(
+    int pid /* Process being created */
+)
+{
+    struct pcb *p = proctab(pid);
+    uintptr_t a = (uintptr_t)stklow(p);
+    uintptr_t end = (uintptr_t)p->stack_base + sizeof(uint32_t);
+    uintptr_t next;
+
+    /* Pages not yet grown into are painted when they fault in */
+    while (a < end) {
+        next = (a & ~(PAGE_SIZE - 1)) + PAGE_SIZE;
+        if (next > end)
+            next = end;
+        if (vmmapped((void *)a))
+            memset((void *)a, STKPAINT, next - a);
+        a = next;
+    }
+}
+
+/*------------------------------------------------------------------------
+* stkcheck - Report, once, a process that has run past its stack limit.
+*            Called by schedule() as the process is switched out. A
+*            pooled stack still has its guard page below; a heap stack
+*            has overwritten its neighbour by now.
+*------------------------------------------------------------------------
+*/
+void stkcheck(
+    int pid /* Process being switched out */
+)
+{
+    struct pcb *p = proctab(pid);
+    uint32_t *low;
+
+    if (p->stack_base == NULL || (p->pflags & (PF_IDLE | PF_STKOVF)))
+        return;
+    low = stklow(p);
+    if (!vmmapped(low) || *low == STKPAINTWORD)
+        return;
+
+    p->pflags |= PF_STKOVF;
+    serial_puts("stack overflow: pid ");
+    serial_putdec(pid);
+    serial_puts(" (");
+    serial_puts(p->name);
+    serial_puts(") went below its ");
+    serial_putdec(p->stack_size);
+    serial_puts("-byte stack\n");
+}
+
+/*------------------------------------------------------------------------
+* stkpeak - Most stack pid has used so far, in bytes, or -1
+*------------------------------------------------------------------------
+*/
+int stkpeak(
+    int pid /* Process to measure */
+)
+{
+    intmask mask; /* Saved interrupt mask */
+    struct pcb *p;
+    uint32_t *w, *end;
+    int used;
+
+    mask = disable();
+    if (isbadpid(pid) || (p = proctab(pid))->stack_base == NULL
+            || isidle(pid)) {
+        restore(mask);
+        return -1;
+    }
+
+    w = stklow(p);
+    end = (uint32_t *)p->stack_base + 1;
+    while (w < end) {
+        if (!vmmapped(w)) {
+            /* Never grown into: skip the page */
+            w = (uint32_t *)(((uintptr_t)w & ~(PAGE_SIZE - 1)) + PAGE_SIZE);
+            continue;
+        }
+        if (*w != STKPAINTWORD)
+            break;
+        w++;
+    }
+    used = (int)((uintptr_t)end - (uintptr_t)w);
+    restore(mask);
+    return used;
+}
+
+/*------------------------------------------------------------------------
+* stkreport - Print stack size and high-water mark for every process
+*------------------------------------------------------------------------
+*/
+void stkreport(void)
+{
+    int used;
+
+    serial_puts("  pid\tname\tsize\tpeak\n");
+    for (int pid = 0; pid < npid; pid++) {
+        used = stkpeak(pid);
+        if (used < 0)
+            continue;
+        serial_puts("  ");
+        serial_putdec(pid);
+        serial_puts("\t");
+        serial_puts(proctab(pid)->name);
+        serial_puts("\t");
+        serial_putdec(proctab(pid)->stack_size);
+        serial_puts("\t");
+        serial_putdec(used);
+        if (proctab(pid)->pflags & PF_STKOVF)
+            serial_puts("\tOVERFLOW");
+        serial_puts("\n");
+    }
+}
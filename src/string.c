@@ -1,15 +1,171 @@
-/* string.c - String utility implementations */
+/* string.c - String and memory utility implementations */
 #include "string.h"
 
+int memsse2 = 0;
+
+/* Word access to byte buffers without breaking strict aliasing */
+typedef uint32_t __attribute__((may_alias)) word_t;
+
+/* Nonzero if any byte of w is zero (Mycroft's has-zero-byte test) */
+#define ONES        0x01010101u
+#define HIGHS       0x80808080u
+#define HASZERO(w)  (((w) - ONES) & ~(w) & HIGHS)
+
+/* The kernel is built without -msse, so GCC does not know the XMM
+ * registers and must not be told they are clobbered. */
+#ifdef __SSE__
+#define XMMCLOBBER  "xmm0", "xmm1", "xmm2", "xmm3",
+#else
+#define XMMCLOBBER
+#endif
+
+/* The SSE2 paths borrow xmm0-3 only while the FPU holds the running
+ * process's state (CR0.TS clear, fpu.c), and put them back: they never
+ * trap, and an interrupt handler using them disturbs nobody. If the
+ * copy is preempted, the switch saves the borrowed registers with the
+ * process's state. */
+#ifdef KACCHI_HOSTED
+#define FPULIVE()   1
+#else
+#include "x86.h"
+#define FPULIVE()   (!(read_cr0() & CR0_TS))
+#endif
+
+/* Below this, a plain loop beats the startup cost of rep movs/stos */
+#define MEMREPMIN   32
+
+/* Forward copy: rep movsl for the words, rep movsb for the tail */
+static inline void repcopy(uint8_t *d, const uint8_t *s, size_t n)
+{
+    size_t words = n >> 2;
+
+    __asm__ volatile ("rep movsl\n\t"
+                      "movl %3, %%ecx\n\t"
+                      "rep movsb"
+                      : "+D"(d), "+S"(s), "+c"(words)
+                      : "r"((uint32_t)(n & 3))
+                      : "memory");
+}
+
+/* Fill: rep stosl for the words, rep stosb for the tail */
+static inline void repfill(uint8_t *d, uint32_t v, size_t n)
+{
+    size_t words = n >> 2;
+
+    __asm__ volatile ("rep stosl\n\t"
+                      "movl %3, %%ecx\n\t"
+                      "rep stosb"
+                      : "+D"(d), "+c"(words)
+                      : "a"(v), "r"((uint32_t)(n & 3))
+                      : "memory");
+}
+
+/* Save and put back the XMM registers the SSE2 paths use */
+static inline void sse2save(uint8_t *buf)
+{
+    __asm__ volatile ("movdqu %%xmm0,   (%0)\n\t"
+                      "movdqu %%xmm1, 16(%0)\n\t"
+                      "movdqu %%xmm2, 32(%0)\n\t"
+                      "movdqu %%xmm3, 48(%0)"
+                      :
+                      : "r"(buf)
+                      : "memory");
+}
+
+static inline void sse2restore(const uint8_t *buf)
+{
+    __asm__ volatile ("movdqu   (%0), %%xmm0\n\t"
+                      "movdqu 16(%0), %%xmm1\n\t"
+                      "movdqu 32(%0), %%xmm2\n\t"
+                      "movdqu 48(%0), %%xmm3"
+                      :
+                      : "r"(buf)
+                      : XMMCLOBBER "memory");
+}
+
+/* Copy 16 bytes between unaligned addresses */
+static inline void sse2copy16(uint8_t *d, const uint8_t *s)
+{
+    __asm__ volatile ("movdqu (%1), %%xmm0\n\t"
+                      "movdqu %%xmm0, (%0)"
+                      :
+                      : "r"(d), "r"(s)
+                      : XMMCLOBBER "memory");
+}
+
+/* Copy 64-byte blocks to a 16-byte aligned destination */
+static void sse2copy(uint8_t *d, const uint8_t *s, size_t blocks)
+{
+    __asm__ volatile ("1:\n\t"
+                      "movdqu   (%1), %%xmm0\n\t"
+                      "movdqu 16(%1), %%xmm1\n\t"
+                      "movdqu 32(%1), %%xmm2\n\t"
+                      "movdqu 48(%1), %%xmm3\n\t"
+                      "movdqa %%xmm0,   (%0)\n\t"
+                      "movdqa %%xmm1, 16(%0)\n\t"
+                      "movdqa %%xmm2, 32(%0)\n\t"
+                      "movdqa %%xmm3, 48(%0)\n\t"
+                      "add $64, %0\n\t"
+                      "add $64, %1\n\t"
+                      "dec %2\n\t"
+                      "jnz 1b"
+                      : "+r"(d), "+r"(s), "+r"(blocks)
+                      :
+                      : XMMCLOBBER "memory");
+}
+
+/* Fill 64-byte blocks at a 16-byte aligned destination */
+static void sse2fill(uint8_t *d, uint32_t v, size_t blocks)
+{
+    __asm__ volatile ("movd %2, %%xmm0\n\t"
+                      "pshufd $0, %%xmm0, %%xmm0\n\t"
+                      "1:\n\t"
+                      "movdqa %%xmm0,   (%0)\n\t"
+                      "movdqa %%xmm0, 16(%0)\n\t"
+                      "movdqa %%xmm0, 32(%0)\n\t"
+                      "movdqa %%xmm0, 48(%0)\n\t"
+                      "add $64, %0\n\t"
+                      "dec %1\n\t"
+                      "jnz 1b"
+                      : "+r"(d), "+r"(blocks)
+                      : "r"(v)
+                      : XMMCLOBBER "memory");
+}
+
 size_t strlen(const char* str) {
-    size_t len = 0;
-    while (str[len]) {
-        len++;
+    const char *s = str;
+    const word_t *w;
+
+    /* Step to a word boundary; aligned words never cross a page */
+    for (; (uintptr_t)s & 3; s++) {
+        if (*s == '\0')
+            return s - str;
     }
-    return len;
+    for (w = (const word_t *)s; !HASZERO(*w); w++)
+        ;
+    for (s = (const char *)w; *s; s++)
+        ;
+    return s - str;
 }
 
 int strcmp(const char* str1, const char* str2) {
+    /* Compare a word at a time when both strings share an alignment */
+    if ((((uintptr_t)str1 ^ (uintptr_t)str2) & 3) == 0) {
+        const word_t *w1, *w2;
+
+        for (; (uintptr_t)str1 & 3; str1++, str2++) {
+            if (*str1 == '\0' || *str1 != *str2)
+                return *(unsigned char*)str1 - *(unsigned char*)str2;
+        }
+        w1 = (const word_t *)str1;
+        w2 = (const word_t *)str2;
+        while (*w1 == *w2 && !HASZERO(*w1)) {
+            w1++;
+            w2++;
+        }
+        str1 = (const char *)w1;
+        str2 = (const char *)w2;
+    }
     while (*str1 && (*str1 == *str2)) {
         str1++;
         str2++;
@@ -18,7 +174,139 @@ int strcmp(const char* str1, const char* str2) {
 }
 
 char* strcpy(char* dest, const char* src) {
-    char* original_dest = dest;
-    while ((*dest++ = *src++));
-    return original_dest;
-}
\ No newline at end of file
+    memcpy(dest, src, strlen(src) + 1);
+    return dest;
+}
+
+/*------------------------------------------------------------------------
+ * memcpy - Copy n bytes; the buffers must not overlap
+ *------------------------------------------------------------------------
+ */
+void *memcpy(void *dest, const void *src, size_t n)
+{
+    uint8_t *d = dest;
+    const uint8_t *s = src;
+
+    if (n < MEMREPMIN) {
+        while (n--)
+            *d++ = *s++;
+        return dest;
+    }
+    if (memsse2 && n >= MEMSSEMIN && FPULIVE()) {
+        size_t head = -(uintptr_t)d & 15;
+        uint8_t xmm[64];
+
+        sse2save(xmm);
+        /* One unaligned 16-byte copy covers the head */
+        if (head) {
+            sse2copy16(d, s);
+            d += head;
+            s += head;
+            n -= head;
+        }
+        sse2copy(d, s, n >> 6);
+        sse2restore(xmm);
+        d += n & ~(size_t)63;
+        s += n & ~(size_t)63;
+        n &= 63;
+    }
+    repcopy(d, s, n);
+    return dest;
+}
+
+/*------------------------------------------------------------------------
+ * memmove - Copy n bytes; the buffers may overlap
+ *------------------------------------------------------------------------
+ */
+void *memmove(void *dest, const void *src, size_t n)
+{
+    uint8_t *d = dest;
+    const uint8_t *s = src;
+    size_t words;
+
+    if (d + n <= s || d >= s + n)
+        return memcpy(dest, src, n);
+
+    /* dest below src: rep movs reads ahead of what it has written */
+    if (d < s) {
+        repcopy(d, s, n);
+        return dest;
+    }
+
+    /* dest overlaps the tail of src: copy downwards */
+    while (n & 3) {
+        n--;
+        d[n] = s[n];
+    }
+    words = n >> 2;
+    if (words > 0) {
+        d += n - 4;
+        s += n - 4;
+        __asm__ volatile ("std\n\t"
+                          "rep movsl\n\t"
+                          "cld"
+                          : "+D"(d), "+S"(s), "+c"(words)
+                          :
+                          : "memory");
+    }
+    return dest;
+}
+
+/*------------------------------------------------------------------------
+ * memset - Fill n bytes with the byte c
+ *------------------------------------------------------------------------
+ */
+void *memset(void *dest, int c, size_t n)
+{
+    uint8_t *d = dest;
+    uint32_t v = (uint8_t)c * ONES;
+
+    if (n < MEMREPMIN) {
+        while (n--)
+            *d++ = (uint8_t)c;
+        return dest;
+    }
+    if (memsse2 && n >= MEMSSEMIN && FPULIVE()) {
+        size_t head = -(uintptr_t)d & 15;
+        uint8_t xmm[64];
+
+        if (head) {
+            repfill(d, v, head);
+            d += head;
+            n -= head;
+        }
+        sse2save(xmm);
+        sse2fill(d, v, n >> 6);
+        sse2restore(xmm);
+        d += n & ~(size_t)63;
+        n &= 63;
+    } else {
+        /* Align the destination for rep stosl */
+        for (; n > 0 && ((uintptr_t)d & 3); n--)
+            *d++ = (uint8_t)c;
+    }
+    repfill(d, v, n);
+    return dest;
+}
+
+/*------------------------------------------------------------------------
+ * memcmp - Compare n bytes
+ *------------------------------------------------------------------------
+ */
+int memcmp(const void *s1, const void *s2, size_t n)
+{
+    const uint8_t *a = s1;
+    const uint8_t *b = s2;
+
+    /* Skip equal words, then find the differing byte */
+    while (n >= 4 && *(const word_t *)a == *(const word_t *)b) {
+        a += 4;
+        b += 4;
+        n -= 4;
+    }
+    for (; n > 0; n--, a++, b++) {
+        if (*a != *b)
+            return *a - *b;
+    }
+    return 0;
+}
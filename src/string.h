@@ -1,11 +1,23 @@
-/* string.h - String utility functions */
+/* string.h - String and memory utility functions */
 #ifndef STRING_H
 #define STRING_H
 
 #include "types.h"
 
+/* Copies of at least this many bytes take the SSE2 path when enabled
+ * and the running process has the FPU loaded */
+#define MEMSSEMIN  256
+
+/* Nonzero once cpu_init has enabled SSE and found SSE2 */
+extern int memsse2;
+
 size_t strlen(const char* str);
 int strcmp(const char* str1, const char* str2);
 char* strcpy(char* dest, const char* src);
 
-#endif
\ No newline at end of file
+void *memcpy(void *dest, const void *src, size_t n);
+void *memmove(void *dest, const void *src, size_t n);
+void *memset(void *dest, int c, size_t n);
+int memcmp(const void *s1, const void *s2, size_t n);
+
+#endif
@@ -0,0 +1,372 @@
+/* sync.c - Wait queues, semaphores, mutexes and condition variables */
+#include "types.h"
+#include "intr.h"
+#include "process.h"
+#include "scheduler.h"
+#include "sync.h"
+
+/* ---------- WAIT QUEUE HELPERS ---------- */
+
+static void wq_append(struct waitq *wq, struct pcb *p)
+{
+    p->qnext = NULL;
+    p->qprev = wq->wqtail;
+    if (wq->wqtail != NULL)
+        wq->wqtail->qnext = p;
+    else
+        wq->wqhead = p;
+    wq->wqtail = p;
+}
+
+static struct pcb *wq_dequeue(struct waitq *wq)
+{
+    struct pcb *p = wq->wqhead;
+
+    if (p == NULL)
+        return NULL;
+    wq->wqhead = p->qnext;
+    if (wq->wqhead != NULL)
+        wq->wqhead->qprev = NULL;
+    else
+        wq->wqtail = NULL;
+    p->qnext = p->qprev = NULL;
+    return p;
+}
+
+/* Move every waiter on src to the end of dst */
+static void wq_splice(struct waitq *dst, struct waitq *src)
+{
+    if (src->wqhead == NULL)
+        return;
+    if (dst->wqtail != NULL) {
+        dst->wqtail->qnext = src->wqhead;
+        src->wqhead->qprev = dst->wqtail;
+    } else {
+        dst->wqhead = src->wqhead;
+    }
+    dst->wqtail = src->wqtail;
+    src->wqhead = src->wqtail = NULL;
+}
+
+/* Queue the current process without giving up the CPU yet */
+static int wq_park(struct waitq *wq)
+{
+    if (isidle(currpid))
+        return -1; /* An idle process must stay runnable */
+    proctab(currpid)->state = PR_WAIT;
+    wq_append(wq, proctab(currpid));
+    return 0;
+}
+
+/* ---------- WAIT QUEUE ---------- */
+
+void wq_init(struct waitq *wq)
+{
+    wq->wqhead = wq->wqtail = NULL;
+}
+
+int wq_empty(struct waitq *wq)
+{
+    return wq->wqhead == NULL;
+}
+
+/*------------------------------------------------------------------------
+* wq_sleep - Wait on wq until a waker readies us. Call with interrupts
+*            disabled, after the check that decided to wait.
+*------------------------------------------------------------------------
+*/
+int wq_sleep(
+    struct waitq *wq /* Queue to wait on */
+)
+{
+    if (wq_park(wq) != 0)
+        return -1;
+    schedule();
+    return 0;
+}
+
+/*------------------------------------------------------------------------
+* wq_wakeone - Ready the oldest waiter; returns its PID or -1
+*------------------------------------------------------------------------
+*/
+int wq_wakeone(
+    struct waitq *wq /* Queue to wake from */
+)
+{
+    intmask mask; /* Saved interrupt mask */
+    struct pcb *p;
+
+    mask = disable();
+    p = wq_dequeue(wq);
+    if (p == NULL) {
+        restore(mask);
+        return -1;
+    }
+    ready(p->pid);
+    restore(mask);
+    return p->pid;
+}
+
+/*------------------------------------------------------------------------
+* wq_wakeall - Ready every waiter in FIFO order; returns how many
+*------------------------------------------------------------------------
+*/
+int wq_wakeall(
+    struct waitq *wq /* Queue to empty */
+)
+{
+    intmask mask; /* Saved interrupt mask */
+    struct pcb *p;
+    int n = 0;
+
+    mask = disable();
+    while ((p = wq_dequeue(wq)) != NULL) {
+        ready(p->pid);
+        n++;
+    }
+    restore(mask);
+    return n;
+}
+
+/* ---------- SEMAPHORE ---------- */
+
+void sem_init(struct sem *s, int count)
+{
+    s->scount = count;
+    wq_init(&s->swait);
+}
+
+/*------------------------------------------------------------------------
+* sem_wait - Take one unit, waiting for sem_signal if none is left
+*------------------------------------------------------------------------
+*/
+int sem_wait(
+    struct sem *s /* Semaphore */
+)
+{
+    intmask mask; /* Saved interrupt mask */
+    int ret = 0;
+
+    mask = disable();
+    if (s->scount > 0)
+        s->scount--;
+    else
+        ret = wq_sleep(&s->swait); /* sem_signal hands us its unit */
+    restore(mask);
+    return ret;
+}
+
+/*------------------------------------------------------------------------
+* sem_trywait - Take one unit if one is free, else return -1
+*------------------------------------------------------------------------
+*/
+int sem_trywait(
+    struct sem *s /* Semaphore */
+)
+{
+    intmask mask; /* Saved interrupt mask */
+
+    mask = disable();
+    if (s->scount <= 0) {
+        restore(mask);
+        return -1;
+    }
+    s->scount--;
+    restore(mask);
+    return 0;
+}
+
+/*------------------------------------------------------------------------
+* sem_signal - Release one unit: straight to the oldest waiter if any
+*------------------------------------------------------------------------
+*/
+int sem_signal(
+    struct sem *s /* Semaphore */
+)
+{
+    intmask mask; /* Saved interrupt mask */
+
+    mask = disable();
+    if (wq_wakeone(&s->swait) < 0)
+        s->scount++;
+    restore(mask);
+    return 0;
+}
+
+/* ---------- MUTEX ---------- */
+
+void mutex_init(struct mutex *m)
+{
+    m->mowner = -1;
+    wq_init(&m->mwait);
+}
+
+/*------------------------------------------------------------------------
+* mutex_lock - Acquire m, waiting while another process holds it
+*------------------------------------------------------------------------
+*/
+int mutex_lock(
+    struct mutex *m /* Mutex */
+)
+{
+    intmask mask; /* Saved interrupt mask */
+    int ret = 0;
+
+    mask = disable();
+    if (m->mowner == currpid) {
+        restore(mask);
+        return -1; /* Not recursive */
+    }
+    if (m->mowner < 0)
+        m->mowner = currpid;
+    else
+        ret = wq_sleep(&m->mwait); /* mutex_unlock makes us the owner */
+    restore(mask);
+    return ret;
+}
+
+/*------------------------------------------------------------------------
+* mutex_trylock - Acquire m if it is free, else return -1
+*------------------------------------------------------------------------
+*/
+int mutex_trylock(
+    struct mutex *m /* Mutex */
+)
+{
+    intmask mask; /* Saved interrupt mask */
+
+    mask = disable();
+    if (m->mowner >= 0) {
+        restore(mask);
+        return -1;
+    }
+    m->mowner = currpid;
+    restore(mask);
+    return 0;
+}
+
+/* Pass m to its oldest waiter, or leave it free; interrupts disabled */
+static void mutex_release(struct mutex *m)
+{
+    struct pcb *p = wq_dequeue(&m->mwait);
+
+    if (p == NULL) {
+        m->mowner = -1;
+        return;
+    }
+    m->mowner = p->pid;
+    ready(p->pid);
+}
+
+/*------------------------------------------------------------------------
+* mutex_unlock - Release m; only its owner may
+*------------------------------------------------------------------------
+*/
+int mutex_unlock(
+    struct mutex *m /* Mutex held by the caller */
+)
+{
+    intmask mask; /* Saved interrupt mask */
+
+    mask = disable();
+    if (m->mowner != currpid) {
+        restore(mask);
+        return -1;
+    }
+    mutex_release(m);
+    restore(mask);
+    return 0;
+}
+
+/* ---------- CONDITION VARIABLE ---------- */
+
+void cond_init(struct cond *c)
+{
+    wq_init(&c->cwait);
+    c->cmutex = NULL;
+}
+
+/*------------------------------------------------------------------------
+* cond_wait - Release m and wait for a signal; returns holding m again
+*------------------------------------------------------------------------
+*/
+int cond_wait(
+    struct cond *c,     /* Condition to wait for */
+    struct mutex *m     /* Held by the caller */
+)
+{
+    intmask mask; /* Saved interrupt mask */
+
+    mask = disable();
+    if (m->mowner != currpid
+            || (!wq_empty(&c->cwait) && c->cmutex != m)) {
+        restore(mask);
+        return -1;
+    }
+
+    c->cmutex = m;
+    if (wq_park(&c->cwait) != 0) {
+        restore(mask);
+        return -1;
+    }
+    mutex_release(m);
+    schedule(); /* Readied only once we own m again */
+
+    restore(mask);
+    return 0;
+}
+
+/* Give a signalled waiter the mutex, or queue it on the mutex */
+static void cond_move(struct cond *c, struct pcb *p)
+{
+    struct mutex *m = c->cmutex;
+
+    if (m->mowner < 0) {
+        m->mowner = p->pid;
+        ready(p->pid);
+    } else {
+        wq_append(&m->mwait, p);
+    }
+}
+
+/*------------------------------------------------------------------------
+* cond_signal - Wake the oldest waiter on c
+*------------------------------------------------------------------------
+*/
+int cond_signal(
+    struct cond *c /* Condition */
+)
+{
+    intmask mask; /* Saved interrupt mask */
+    struct pcb *p;
+
+    mask = disable();
+    p = wq_dequeue(&c->cwait);
+    if (p != NULL)
+        cond_move(c, p);
+    restore(mask);
+    return 0;
+}
+
+/*------------------------------------------------------------------------
+* cond_broadcast - Wake every waiter on c. They queue up on the mutex
+*                  in one splice; only the first can run before the
+*                  others are handed the mutex in turn.
+*------------------------------------------------------------------------
+*/
+int cond_broadcast(
+    struct cond *c /* Condition */
+)
+{
+    intmask mask; /* Saved interrupt mask */
+    struct pcb *p;
+
+    mask = disable();
+    p = wq_dequeue(&c->cwait);
+    if (p != NULL) {
+        cond_move(c, p);
+        wq_splice(&c->cmutex->mwait, &c->cwait);
+    }
+    restore(mask);
+    return 0;
+}
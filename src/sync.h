@@ -0,0 +1,62 @@
+/* sync.h - Wait queues, semaphores, mutexes and condition variables */
+#ifndef SYNC_H
+#define SYNC_H
+
+#include "types.h"
+#include "process.h"
+
+/* -----------------------------
+ * Wait queue
+ * -----------------------------
+ * A FIFO of processes in PR_WAIT, linked through the qnext/qprev
+ * fields of their PCBs, so waiting costs no memory and every queue
+ * operation is O(1). Wakers hand over what the waiter wanted (a
+ * semaphore count, mutex ownership) before making it ready, so a woken
+ * process never has to re-check and re-sleep.
+ */
+struct waitq {
+    struct pcb *wqhead;
+    struct pcb *wqtail;
+};
+
+void wq_init(struct waitq *wq);
+int wq_empty(struct waitq *wq);
+int wq_sleep(struct waitq *wq);
+int wq_wakeone(struct waitq *wq);
+int wq_wakeall(struct waitq *wq);
+
+/* Counting semaphore */
+struct sem {
+    int scount;             /* Units available */
+    struct waitq swait;
+};
+
+void sem_init(struct sem *s, int count);
+int sem_wait(struct sem *s);
+int sem_trywait(struct sem *s);
+int sem_signal(struct sem *s);
+
+/* Mutex; unlock hands it straight to the oldest waiter */
+struct mutex {
+    int mowner;             /* Holding PID, or -1 */
+    struct waitq mwait;
+};
+
+void mutex_init(struct mutex *m);
+int mutex_lock(struct mutex *m);
+int mutex_trylock(struct mutex *m);
+int mutex_unlock(struct mutex *m);
+
+/* Condition variable. Signalled waiters move to the mutex's queue
+ * instead of waking only to block on the mutex again. */
+struct cond {
+    struct waitq cwait;
+    struct mutex *cmutex;   /* Mutex the waiters hold, set by cond_wait */
+};
+
+void cond_init(struct cond *c);
+int cond_wait(struct cond *c, struct mutex *m);
+int cond_signal(struct cond *c);
+int cond_broadcast(struct cond *c);
+
+#endif
@@ -0,0 +1,93 @@
+/* trace.c - trdump */
+#include "types.h"
+#include "string.h"
+#include "serial.h"
+#include "process.h"
+#include "intr.h"
+#include "clock.h"
+#include "trace.h"
+
+_Static_assert(sizeof(struct trevent) == 16, "trevent is 16 bytes on the wire");
+_Static_assert(sizeof(struct trhdr) == 20, "trhdr has no padding");
+_Static_assert(PNMLEN == sizeof(((struct trname *)0)->name), "trname fits a name");
+_Static_assert((TRACEN & (TRACEN - 1)) == 0, "TRACEN is a power of two");
+
+struct trevent trring[TRACEN];
+uint32_t trhead;
+int traceon = 1;
+
+static uint32_t trsum;  /* Checksum of the dump being written */
+
+/* Write raw bytes into the dump, adding them to the checksum */
+static void trput(const void *buf, uint32_t n)
+{
+    const uint8_t *p = buf;
+
+    for (uint32_t i = 0; i < n; i++)
+        trsum += p[i];
+    serial_write(buf, n);
+}
+
+/*------------------------------------------------------------------------
+* trdump - Write the trace ring to COM1 as one binary frame (trace.h),
+*          oldest event first, then empty it. Tracing is off and COM1
+*          held (serial_lock) while the frame goes out, so no other
+*          output lands inside it; needs interrupts on to time the TSC.
+*------------------------------------------------------------------------
+*/
+void trdump(void)
+{
+    intmask mask; /* Saved interrupt mask */
+    struct trhdr h;
+    struct trname nm;
+    uint32_t n, first;
+
+    /* Anyone logging holds the kernel lock: the ring is still now */
+    mask = disable();
+    traceon = 0;
+    restore(mask);
+
+    n = (trhead < TRACEN) ? trhead : TRACEN;
+    first = trhead - n;
+
+    memcpy(h.magic, TRMAGIC, sizeof(h.magic));
+    h.version = TRVERSION;
+    h.evsize = sizeof(struct trevent);
+    h.nevent = n;
+    h.nlost = first;
+    h.tsckhz = tsckhz();
+
+    serial_lock();
+    serial_write(h.magic, sizeof(h.magic));
+    trsum = 0;
+    trput(&h.version, sizeof(h) - sizeof(h.magic));
+    for (uint32_t i = first; i < trhead; i++)
+        trput(&trring[i & (TRACEN - 1)], sizeof(struct trevent));
+
+    /* Names of the processes alive now; the converter falls back to
+     * PIDs for the rest */
+    for (int pid = 0; pid < npid; pid++) {
+        mask = disable();
+        if (proctab(pid)->state == PR_FREE) {
+            restore(mask);
+            continue;
+        }
+        nm.pid = pid;
+        memcpy(nm.name, proctab(pid)->name, sizeof(nm.name));
+        restore(mask);
+        trput(&nm, sizeof(nm));
+    }
+    memset(&nm, 0, sizeof(nm));
+    nm.pid = TRNONAME;
+    trput(&nm, sizeof(nm));
+
+    n = trsum;
+    serial_write(&n, sizeof(n));
+    serial_write(TRENDMAGIC, 4);
+    serial_unlock();
+
+    mask = disable();
+    trhead = 0;
+    traceon = 1;
+    restore(mask);
+}
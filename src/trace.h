@@ -0,0 +1,96 @@
+/* trace.h - Scheduler and IPC event trace */
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "types.h"
+
+/* -----------------------------
+ * Events
+ * -----------------------------
+ * Each event is 16 bytes, stamped with the TSC of the CPU that logged
+ * it. host/trace2json reads them from the dump trdump() writes; keep
+ * the two in step (TRVERSION).
+ */
+#define TR_SCHED    1   /* schedule() entered by pid; arg = rq_ready */
+#define TR_SWITCH   2   /* pid off, arg = next | old's state << 16 */
+#define TR_BLOCK    3   /* block_current(): pid */
+#define TR_WAKEUP   4   /* pid made arg runnable */
+#define TR_SEND     5   /* pid sent arg >> 16 messages to arg & 0xFFFF */
+#define TR_RECV     6   /* pid took arg messages */
+
+struct trevent {
+    uint64_t tsc;       /* rdtsc when logged */
+    uint8_t  type;      /* TR_* */
+    uint8_t  cpu;       /* Index in cpus[] */
+    uint16_t pid;       /* Process the event is about */
+    uint32_t arg;       /* Depends on type */
+};
+
+/* Dump framing, all little-endian: struct trhdr; nevent struct
+ * trevent, oldest first; a struct trname per live process, then one
+ * with pid TRNONAME; a uint32_t sum of every byte after TRMAGIC up to
+ * it; and TRENDMAGIC. */
+#define TRMAGIC     "KTRC"
+#define TRENDMAGIC  "CRTK"
+#define TRVERSION   1
+#define TRNONAME    0xFFFFFFFF
+
+struct trhdr {
+    char     magic[4];  /* TRMAGIC */
+    uint16_t version;   /* TRVERSION */
+    uint16_t evsize;    /* sizeof(struct trevent) */
+    uint32_t nevent;    /* Events that follow */
+    uint32_t nlost;     /* Older events the ring overwrote */
+    uint32_t tsckhz;    /* TSC ticks per millisecond, measured */
+};
+
+struct trname {
+    uint32_t pid;
+    char     name[16];  /* PNMLEN */
+};
+
+#ifndef KACCHI_HOSTED
+
+#include "x86.h"
+#include "smp.h"
+
+/* Events the ring holds; a power of two.
+ * Override with make CFLAGS+=-DTRACEN=... */
+#ifndef TRACEN
+#define TRACEN      4096
+#endif
+
+extern struct trevent trring[TRACEN];
+extern uint32_t trhead;     /* Events ever logged; next goes here */
+extern int traceon;
+
+/* Log an event. Callers hold the kernel lock, which serializes the
+ * ring across CPUs. */
+static inline void trace(int type, int pid, uint32_t arg)
+{
+    struct trevent *e;
+
+    if (!traceon)
+        return;
+    e = &trring[trhead++ & (TRACEN - 1)];
+    e->tsc = rdtsc();
+    e->type = type;
+    e->cpu = mycpu()->cpuid;
+    e->pid = pid;
+    e->arg = arg;
+}
+
+void trdump(void);
+
+#else
+
+/* Host builds keep no trace */
+static inline void trace(int type, int pid, uint32_t arg) {
+    (void)type;
+    (void)pid;
+    (void)arg;
+}
+
+#endif /* KACCHI_HOSTED */
+
+#endif
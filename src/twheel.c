@@ -0,0 +1,107 @@
+/* twheel.c - twinit, twinsert, twremove, twtick */
+#include "types.h"
+#include "clock.h"
+#include "process.h"
+#include "scheduler.h"
+
+/* Slot heads; tslot in a sleeping PCB indexes this as a flat array */
+static struct pcb *twheel[TW_LEVELS][TW_SIZE];
+
+void twinit(void)
+{
+    for (int lvl = 0; lvl < TW_LEVELS; lvl++)
+        for (int i = 0; i < TW_SIZE; i++)
+            twheel[lvl][i] = NULL;
+}
+
+/*------------------------------------------------------------------------
+* twinsert - Put a process on the wheel to wake at tick when. Wakeups
+*            beyond the top level's reach park in its last lap and are
+*            re-filed when that slot cascades.
+*------------------------------------------------------------------------
+*/
+void twinsert(
+    int pid,        /* Process to wake; not on any queue */
+    uint32_t when   /* Absolute tick (clkticks) to wake at */
+)
+{
+    struct pcb *p = proctab(pid);
+    uint32_t delta = when - clkticks;
+    int lvl = 0;
+    int idx;
+
+    while (lvl < TW_LEVELS - 1 && delta >= (1u << ((lvl + 1) * TW_BITS)))
+        lvl++;
+    idx = (when >> (lvl * TW_BITS)) & TW_MASK;
+
+    p->twake = when;
+    p->tslot = lvl * TW_SIZE + idx;
+    p->qprev = NULL;
+    p->qnext = twheel[lvl][idx];
+    if (p->qnext != NULL)
+        p->qnext->qprev = p;
+    twheel[lvl][idx] = p;
+}
+
+/*------------------------------------------------------------------------
+* twremove - Take a sleeping process off the wheel
+*------------------------------------------------------------------------
+*/
+void twremove(
+    int pid /* Process on the wheel */
+)
+{
+    struct pcb *p = proctab(pid);
+    struct pcb **head = &twheel[0][0] + p->tslot;
+
+    if (p->qprev != NULL)
+        p->qprev->qnext = p->qnext;
+    else
+        *head = p->qnext;
+    if (p->qnext != NULL)
+        p->qnext->qprev = p->qprev;
+    p->qnext = p->qprev = NULL;
+}
+
+/* Re-file every sleeper in one slot against the current tick */
+static void twcascade(int lvl, int idx)
+{
+    struct pcb *p = twheel[lvl][idx];
+    struct pcb *next;
+
+    twheel[lvl][idx] = NULL;
+    for (; p != NULL; p = next) {
+        next = p->qnext;
+        twinsert(p->pid, p->twake);
+    }
+}
+
+/*------------------------------------------------------------------------
+* twtick - Advance the wheel to clkticks and ready whoever is due.
+*          Called once per tick with interrupts disabled; returns the
+*          number of processes woken.
+*------------------------------------------------------------------------
+*/
+int twtick(void)
+{
+    uint32_t now = clkticks;
+    struct pcb *p, *next;
+    int woke = 0;
+
+    /* At the start of each lap of level n, spread its current slot */
+    for (int lvl = 1; lvl < TW_LEVELS; lvl++) {
+        if ((now & ((1u << (lvl * TW_BITS)) - 1)) != 0)
+            break;
+        twcascade(lvl, (now >> (lvl * TW_BITS)) & TW_MASK);
+    }
+
+    p = twheel[0][now & TW_MASK];
+    twheel[0][now & TW_MASK] = NULL;
+    for (; p != NULL; p = next) {
+        next = p->qnext;
+        p->qnext = p->qprev = NULL;
+        ready(p->pid);
+        woke++;
+    }
+    return woke;
+}
@@ -2,6 +2,13 @@
 #ifndef TYPES_H
 #define TYPES_H
 
+#ifdef KACCHI_HOSTED
+/* Host-side tools build kernel sources against the C library */
+#include <stdint.h>
+#include <stddef.h>
+#else
+
+typedef unsigned long long uint64_t;
 typedef unsigned int   uint32_t;
 typedef unsigned short uint16_t;
 typedef unsigned char  uint8_t;
@@ -10,7 +17,10 @@ typedef short          int16_t;
 typedef char           int8_t;
 
 typedef uint32_t size_t;
+typedef uint32_t uintptr_t;
 
 #define NULL  ((void*)0)
 
+#endif /* KACCHI_HOSTED */
+
 #endif
\ No newline at end of file
@@ -0,0 +1,161 @@
+/* x86.h - i386 descriptor tables, control registers and trap frames */
+#ifndef X86_H
+#define X86_H
+
+#include "types.h"
+
+/* -----------------------------
+ * GDT selectors
+ * ----------------------------- */
+
+#define SEG_KCODE   0x08    /* Flat kernel code */
+#define SEG_KDATA   0x10    /* Flat kernel data */
+
+/* Three descriptors per CPU follow the flat ones (cpu 0: 0x18-0x28) */
+#define SEG_TSS(c)   (0x18 + 0x18 * (c))  /* Task state of whatever is running */
+#define SEG_PFTSS(c) (0x20 + 0x18 * (c))  /* Page-fault handler task */
+#define SEG_CPU(c)   (0x28 + 0x18 * (c))  /* %fs: the CPU's struct cpu */
+
+/* -----------------------------
+ * Control register bits
+ * ----------------------------- */
+
+#define CR0_PG      0x80000000  /* Paging */
+#define CR0_WP      0x00010000  /* Honour read-only pages in ring 0 */
+#define CR0_TS      0x00000008  /* Task switched: next FPU use traps (#NM) */
+#define CR0_EM      0x00000004  /* No FPU: trap on x87/SSE instructions */
+#define CR0_MP      0x00000002  /* WAIT honours CR0.TS */
+#define CR4_PSE     0x00000010  /* 4 MB pages */
+#define CR4_OSFXSR  0x00000200  /* OS uses FXSAVE/FXRSTOR; SSE enabled */
+#define CR4_OSXMMEXCPT 0x00000400 /* SIMD exceptions raise #XM */
+
+/* CPUID leaf 1 EDX feature bits */
+#define CPUID_FXSR  (1u << 24)
+#define CPUID_SSE   (1u << 25)
+#define CPUID_SSE2  (1u << 26)
+
+/* CPUID leaf 7 EBX: fast rep movsb/stosb */
+#define CPUID_ERMS  (1u << 9)
+
+#define EFLAGS_IF   0x00000200  /* Interrupts enabled */
+
+/* Hardware task state segment */
+struct tss {
+    uint32_t link;
+    uint32_t esp0, ss0, esp1, ss1, esp2, ss2;
+    uint32_t cr3, eip, eflags;
+    uint32_t eax, ecx, edx, ebx, esp, ebp, esi, edi;
+    uint32_t es, cs, ss, ds, fs, gs, ldt;
+    uint16_t trap, iomap;
+} __attribute__((packed));
+
+/* Stack layout built by the stubs in isr.S */
+struct trapframe {
+    uint32_t edi, esi, ebp, oesp, ebx, edx, ecx, eax;  /* pusha */
+    uint32_t vector;
+    uint32_t errcode;       /* 0 for vectors without one */
+    uint32_t eip, cs, eflags;
+};
+
+void cpu_init(void);
+void gdt_init(void);
+void gdt_initcpu(int cpu);
+void idt_init(void);
+void idt_initcpu(int cpu);
+void set_intr_gate(int vec, void (*handler)(void));
+void set_task_gate(int cpu, int vec, uint16_t sel);
+
+static inline uint32_t read_eflags(void) {
+    uint32_t v;
+    __asm__ volatile ("pushfl; popl %0" : "=r"(v));
+    return v;
+}
+
+static inline uint32_t read_cr0(void) {
+    uint32_t v;
+    __asm__ volatile ("movl %%cr0, %0" : "=r"(v));
+    return v;
+}
+
+static inline void write_cr0(uint32_t v) {
+    __asm__ volatile ("movl %0, %%cr0" : : "r"(v) : "memory");
+}
+
+/* Clear CR0.TS */
+static inline void clts(void) {
+    __asm__ volatile ("clts" : : : "memory");
+}
+
+static inline uint32_t read_cr2(void) {
+    uint32_t v;
+    __asm__ volatile ("movl %%cr2, %0" : "=r"(v));
+    return v;
+}
+
+static inline uint32_t read_cr3(void) {
+    uint32_t v;
+    __asm__ volatile ("movl %%cr3, %0" : "=r"(v));
+    return v;
+}
+
+static inline void write_cr3(uint32_t v) {
+    __asm__ volatile ("movl %0, %%cr3" : : "r"(v) : "memory");
+}
+
+static inline uint32_t read_cr4(void) {
+    uint32_t v;
+    __asm__ volatile ("movl %%cr4, %0" : "=r"(v));
+    return v;
+}
+
+static inline void write_cr4(uint32_t v) {
+    __asm__ volatile ("movl %0, %%cr4" : : "r"(v) : "memory");
+}
+
+static inline void cpuid(uint32_t leaf, uint32_t *a, uint32_t *b,
+                         uint32_t *c, uint32_t *d) {
+    __asm__ volatile ("cpuid"
+                      : "=a"(*a), "=b"(*b), "=c"(*c), "=d"(*d)
+                      : "a"(leaf), "c"(0));
+}
+
+/* Index of the highest set bit; v must be nonzero */
+static inline int bsr(uint32_t v) {
+    uint32_t r;
+    __asm__ ("bsrl %1, %0" : "=r"(r) : "rm"(v));
+    return (int)r;
+}
+
+/* Index of the lowest set bit; v must be nonzero */
+static inline int bsf(uint32_t v) {
+    uint32_t r;
+    __asm__ ("bsfl %1, %0" : "=r"(r) : "rm"(v));
+    return (int)r;
+}
+
+/* Time-stamp counter */
+#ifdef KACCHI_HOSTED
+uint64_t rdtsc(void);   /* Virtual time, from host/schedsim.c */
+uint32_t hosttsckhz(void);  /* Its rate, for tsckhz() */
+#else
+static inline uint64_t rdtsc(void) {
+    uint32_t lo, hi;
+    __asm__ volatile ("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+#endif
+
+/* n / d for a 64-bit n: the kernel has no libgcc for the / operator */
+static inline uint64_t div64(uint64_t n, uint32_t d) {
+    uint32_t hi = (uint32_t)(n >> 32), lo = (uint32_t)n, qhi, qlo, r;
+    qhi = hi / d;
+    r = hi % d;
+    __asm__ ("divl %4" : "=a"(qlo), "=d"(r) : "a"(lo), "d"(r), "rm"(d));
+    return ((uint64_t)qhi << 32) | qlo;
+}
+
+static inline void invlpg(void *va) {
+    __asm__ volatile ("invlpg (%0)" : : "r"(va) : "memory");
+}
+
+#endif